@@ -16,6 +16,7 @@
 
 #include <ctype.h>
 #include <errno.h>
+#include <inttypes.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -24,6 +25,7 @@
 #include <unistd.h>
 #include <arpa/inet.h>
 #include <sys/select.h>
+#include <sys/stat.h>
 #include "console.h"
 #include "game_client.h"
 #include "netutil.h"
@@ -77,6 +79,7 @@ static inline void show_help()
 		puts("\nAvailable commands:\n"
 				"!help --> shows the list of available commands\n"
 				"!who --> shows the list of connected players\n"
+				"!matches --> shows the list of matches in progress\n"
 				"!connect username --> starts a game with the specified player\n"
 				"!quit --> disconnects and exits");
 	else
@@ -501,6 +504,9 @@ static void send_play_request(const char *username)
 		printf("%s is currently AFK. Request timed out.\n",
 				username);
 		break;
+	case PLAY_ALREADY_IN_GAME:
+		printf("You are already in a match.\n");
+		break;
 	default:
 		print_error("Invalid response from server.", 0);
 	}
@@ -521,7 +527,7 @@ static void print_player_list()
 	if (!send_req_who(server_sock))
 		return;
 
-	ans = (struct ans_who *)read_message(server_sock);
+	ans = (struct ans_who *)read_message_type(server_sock, ANS_WHO);
 	if (!ans)
 		return;
 
@@ -568,6 +574,49 @@ static void print_player_list()
 	delete_message(ans);
 }
 
+/* !matches */
+static void print_match_list()
+{
+	struct ans_matches *ans;
+	int i, count;
+
+	if (!send_req_matches(server_sock))
+		return;
+
+	ans = (struct ans_matches *)read_message_type(server_sock, ANS_MATCHES);
+	if (!ans)
+		return;
+
+	count = ans->header.length / sizeof(struct match_entry);
+
+	if (count == 0) {
+		puts("There are no matches in progress.");
+		delete_message(ans);
+		return;
+	}
+
+	printf("\n%10s\t%-" STRINGIZE(MAX_USERNAME_LENGTH) "s\t%-"
+			STRINGIZE(MAX_USERNAME_LENGTH) "s\t%s\n\n",
+			"MATCH", "PLAYER 1", "PLAYER 2", "STATUS");
+	for (i = 0; i < count; i++) {
+		if (ans->matches[i].status == PLAYER_AWAITING_REPLY)
+			fputs(COLOR_PLAYER_AWAITING, stdout);
+		else
+			fputs(COLOR_PLAYER_IN_GAME, stdout);
+
+		printf("%10" PRIu32 "\t%-" STRINGIZE(MAX_USERNAME_LENGTH) "s\t%-"
+				STRINGIZE(MAX_USERNAME_LENGTH) "s\t%s\n",
+				ans->matches[i].id, ans->matches[i].player1,
+				ans->matches[i].player2,
+				ans->matches[i].status == PLAYER_AWAITING_REPLY ?
+				"AWAITING REPLY" : "IN GAME");
+
+		fputs(COLOR_RESET, stdout);
+	}
+
+	delete_message(ans);
+}
+
 /* game message dispatch */
 static bool get_opponent_message()
 {
@@ -670,6 +719,8 @@ static void process_std_command(const char *cmd, const char *args)
 		show_help();
 	} else if (strcasecmp(cmd, "!who") == 0) {
 		print_player_list();
+	} else if (strcasecmp(cmd, "!matches") == 0) {
+		print_match_list();
 	} else if (strcasecmp(cmd, "!connect") == 0) {
 		if (args == NULL || !valid_username(args))
 			print_error("!connect requires a valid opponent name as argument.\n",
@@ -945,8 +996,13 @@ static bool do_login()
 	return true;
 }
 
-int main(int argc, char **argv)
+/*
+ * Connects to the server at the address and port given on the command line.
+ * Returns the connection socket, or -1 on error.
+ */
+static int connect_tcp(int argc, char **argv)
 {
+	int sock;
 	uint16_t port;
 	char ipstr[ADDRESS_STRING_LENGTH];
 #if defined(USE_IPV6_ADDRESSING) && USE_IPV6_ADDRESSING == 1
@@ -955,40 +1011,85 @@ int main(int argc, char **argv)
 	struct in_addr addr;
 #endif
 
-	if (argc > 3) {
-		printf("Usage: %s <address> <port>\n", argv[0]);
-		exit(EXIT_SUCCESS);
-	}
 	if (argc > 1) {
 		if (inet_pton(ADDRESS_FAMILY, argv[1], &addr) != 1) {
 			print_error("Invalid address", 0);
-			exit(EXIT_FAILURE);
+			return -1;
 		}
 	}
 	if (argc > 2) {
 		if (!string_to_uint16(argv[2], &port) || port == 0) {
 			print_error("Invalid port. Enter a value between 1 and 65535",
 					0);
-			exit(EXIT_FAILURE);
+			return -1;
 		}
 	} else {
 		port = DEFAULT_SERVER_PORT;
 	}
 
-	server_sock = connect_to_server(addr, htons(port));
-	if (server_sock == -1) {
+	sock = connect_to_server(addr, htons(port));
+	if (sock == -1) {
 		print_error("Could not connect to server", 0);
-		exit(EXIT_FAILURE);
+		return -1;
 	}
 
-	if (!get_peer_address(server_sock, ipstr, ADDRESS_STRING_LENGTH,
-				&port)) {
-		close(server_sock);
-		exit(EXIT_FAILURE);
+	if (!get_peer_address(sock, ipstr, ADDRESS_STRING_LENGTH, &port)) {
+		close(sock);
+		return -1;
 	}
 
 	printf("Successfully connected to server %s:%d (socket: %d)\n",
-			ipstr, port, server_sock);
+			ipstr, port, sock);
+	return sock;
+}
+
+/*
+ * Connects to a server running on the same host through its AF_UNIX socket
+ * (see UNIX_SOCKET_PATH). Returns the connection socket, or -1 on error.
+ */
+static int connect_local(const char *path)
+{
+	int sock;
+
+	sock = connect_to_unix_socket(path);
+	if (sock == -1) {
+		print_error("Could not connect to server", 0);
+		return -1;
+	}
+
+	printf("Successfully connected to server on %s (socket: %d)\n",
+			path, sock);
+	return sock;
+}
+
+/*
+ * Returns true if arg names an AF_UNIX socket rather than an address: an
+ * existing socket file, or any path with a '/'.
+ */
+static bool unix_socket_arg(const char *arg)
+{
+	struct stat st;
+
+	return strchr(arg, '/') || (stat(arg, &st) == 0 &&
+			S_ISSOCK(st.st_mode));
+}
+
+int main(int argc, char **argv)
+{
+	if (argc > 3) {
+		printf("Usage: %s <address> <port>\n"
+				"       %s <unix socket path>\n"
+				"The path is taken as such if it names an existing socket or contains a '/'.\n",
+				argv[0], argv[0]);
+		exit(EXIT_SUCCESS);
+	}
+
+	if (argc == 2 && unix_socket_arg(argv[1]))
+		server_sock = connect_local(argv[1]);
+	else
+		server_sock = connect_tcp(argc, argv);
+	if (server_sock == -1)
+		exit(EXIT_FAILURE);
 
 	memset(&game, 0, sizeof(game));
 
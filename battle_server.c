@@ -14,46 +14,83 @@
  * See file LICENSE for more details.
  */
 
-#include <assert.h>
 #include <errno.h>
+#include <sched.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <time.h>
 #include <unistd.h>
-#include <sys/select.h>
+#include <sys/resource.h>
+#include "buffer.h"
 #include "client_list.h"
 #include "console.h"
 #include "netutil.h"
+#include "poller.h"
 #include "proto.h"
+#include "reactor.h"
 #include "sighandler.h"
+#include "timer.h"
+#include "workpool.h"
 
-static inline void close_range(int start, int stop)
+/* descriptors kept for the server itself (listening sockets, pollers,
+ * mailboxes) and to answer the connections over the cap */
+#define	RESERVED_FDS	64
+
+static struct reactor *reactors;
+static struct workpool workers;
+
+/* MAX_CLIENTS, lowered to fit in the limit of open file descriptors */
+static unsigned int max_clients;
+
+/*
+ * Timers of the play requests, driven by the first reactor. The wheel is
+ * accessed with the client list locked.
+ */
+static struct timer_wheel match_timers;
+
+/*
+ * Sends ANS_PLAY with response res to client, along with the address of its
+ * opponent. A local opponent has the loopback address, which reaches it only
+ * from the host of the server: a remote client is given the address of the
+ * server on its own connection instead.
+ */
+static void send_ans_play_opponent(struct game_client *client,
+		enum play_response res, struct game_client *opponent)
 {
-	for (; start <= stop; start++)
-		close(start);
+#if defined(USE_IPV6_ADDRESSING) && USE_IPV6_ADDRESSING == 1
+	struct sockaddr_in6 sa;
+	struct in6_addr address = opponent->address;
+#else
+	struct sockaddr_in sa;
+	struct in_addr address = opponent->address;
+#endif
+	socklen_t len = sizeof(sa);
+
+	if (opponent->local && !client->local) {
+		errno = 0;
+		if (getsockname(client->sock, (struct sockaddr *)&sa, &len))
+			print_error("getsockname", errno);
+		else
+#if defined(USE_IPV6_ADDRESSING) && USE_IPV6_ADDRESSING == 1
+			address = sa.sin6_addr;
+#else
+			address = sa.sin_addr;
+#endif
+	}
+	send_ans_play(client->sock, res, address, opponent->port);
 }
 
 /*
- * Removes all matches awaiting for response where the timeout is elapsed and
- * sends a message to the involved clients informing them of the timeout.
+ * Removes a match whose play request has not been answered in time and sends
+ * a message to the involved clients informing them of the timeout.
  */
-static void remove_elapsed_matches()
+static void play_request_timeout(struct timer *t)
 {
-	struct game_client *p;
+	struct match *m = TIMER_ENTRY(t, struct match, timeout);
 
-	for (p = first_logged_client(); p; p = next_logged_client())
-		if (p->match && p->match->awaiting_reply &&
-				difftime(time(NULL), p->match->request_time) >=
-				PLAY_REQUEST_TIMEOUT) {
-			send_ans_play(p->match->player2->sock, PLAY_TIMEDOUT,
-					p->match->player1->address,
-					p->match->player1->port);
-			send_ans_play(p->match->player1->sock, PLAY_TIMEDOUT,
-					p->match->player2->address,
-					p->match->player2->port);
-			delete_match(p->match);
-		}
+	send_ans_play_opponent(m->player2, PLAY_TIMEDOUT, m->player1);
+	send_ans_play_opponent(m->player1, PLAY_TIMEDOUT, m->player2);
+	delete_match(m);
 }
 
 /*
@@ -62,20 +99,20 @@ static void remove_elapsed_matches()
  */
 static void terminate_match(struct game_client *client, bool disconnected)
 {
-	int sockfd;
+	struct game_client *opponent;
 
 	if (!client->match)
 		return;
 
-	sockfd = (client == client->match->player1) ?
-		client->match->player2->sock : client->match->player1->sock;
+	opponent = (client == client->match->player1) ?
+		client->match->player2 : client->match->player1;
 
 	if (client->match->awaiting_reply)
-		send_ans_play(sockfd, (client == client->match->player1) ?
-				PLAY_TIMEDOUT : PLAY_DECLINE,
-				client->address, client->port);
+		send_ans_play_opponent(opponent,
+				(client == client->match->player1) ?
+				PLAY_TIMEDOUT : PLAY_DECLINE, client);
 	else
-		send_msg_endgame(sockfd, disconnected);
+		send_msg_endgame(opponent->sock, disconnected);
 
 	delete_match(client->match);
 }
@@ -91,14 +128,14 @@ static void process_play_req_answer(struct game_client *client,
 
 	res = msg->accept ? PLAY_ACCEPT : PLAY_DECLINE;
 
-	send_ans_play(client->match->player1->sock, res,
-			client->match->player2->address,
-			client->match->player2->port);
-	send_ans_play(client->match->player2->sock, res,
-			client->match->player1->address,
-			client->match->player1->port);
+	send_ans_play_opponent(client->match->player1, res,
+			client->match->player2);
+	send_ans_play_opponent(client->match->player2, res,
+			client->match->player1);
 
 	client->match->awaiting_reply = false;
+	timer_cancel(&client->match->timeout);
+	players_changed();
 	if (!msg->accept)
 		delete_match(client->match);
 }
@@ -108,6 +145,14 @@ static void process_play_request(struct game_client *client,
 		struct req_play *msg)
 {
 	struct game_client *opponent;
+	struct match *m;
+
+	/* a client is part of a single match at a time */
+	if (client->match) {
+		send_ans_play(client->sock, PLAY_ALREADY_IN_GAME,
+				client->address, client->port);
+		return;
+	}
 
 	opponent = get_client_by_username(msg->opponent);
 
@@ -122,34 +167,171 @@ static void process_play_request(struct game_client *client,
 		return;
 	}
 
-	add_match(client, opponent);
+	m = add_match(client, opponent);
+	m->timeout.expire = play_request_timeout;
+	timer_add(&match_timers, &m->timeout,
+			client->owner->now + PLAY_REQUEST_TIMEOUT * 1000);
+
+	/* the timers are driven by the first reactor, which may be waiting
+	 * for events until a later deadline */
+	if (current_reactor() != &reactors[0])
+		reactor_wake(&reactors[0]);
 
 	send_req_play(opponent->sock, client->username);
 }
 
-/* !who */
-static void send_client_list(struct game_client *client)
+/*
+ * Entries of a list shared by the answers, freed by the last of its holders:
+ * the list itself, until a newer one replaces it, and the answers copying
+ * them into the output of their clients, without the client list locked.
+ */
+struct shared_list {
+	unsigned int refs;
+	unsigned int count;
+	unsigned long version; /* of the players it was built from */
+	char entries[];
+};
+
+/*
+ * Lists of all the logged in players and of all the matches, shared by the
+ * ANS_WHO and ANS_MATCHES answers until a change of the players or of their
+ * matches makes them stale (NULL until the first is built). Each ANS_WHO
+ * leaves out only the entry of the client answered. Accessed with the client
+ * list locked.
+ */
+static struct shared_list *who_list;
+static struct shared_list *match_list;
+
+static inline bool list_fresh(struct shared_list *list)
 {
-	int count, i;
-	struct game_client *p;
-	struct who_player *players;
-	size_t sz;
+	return list && list->version == players_version();
+}
 
-	count = logged_client_count() - 1;
-	sz = count * sizeof(struct who_player);
+/*
+ * Returns a reference to list, which may be NULL. Must be called with the
+ * client list locked.
+ */
+static struct shared_list *get_list(struct shared_list *list)
+{
+	if (list)
+		__atomic_add_fetch(&list->refs, 1, __ATOMIC_RELAXED);
+	return list;
+}
 
-	players = malloc(sz);
-	if (!players) {
-		print_error("malloc", errno);
-		count = 0;
-		goto send_free_and_exit;
+/* drops a reference to list, freeing it with the last one */
+static void put_list(struct shared_list *list)
+{
+	if (list && __atomic_sub_fetch(&list->refs, 1, __ATOMIC_ACQ_REL) == 0)
+		free(list);
+}
+
+/*
+ * Allocates a list to rebuild *list if it is stale, then locks the client
+ * list. count() returns how many entries are needed, left in the count of the
+ * list as its room. Returns NULL if the list is fresh, or on error, with the
+ * client list unlocked.
+ */
+static struct shared_list *alloc_list(struct shared_list **list,
+		size_t entry_size, size_t (*count)(void))
+{
+	size_t n;
+	struct shared_list *new;
+
+	client_list_lock();
+	while (!list_fresh(*list)) {
+		n = count();
+		client_list_unlock();
+
+		/* zeroed, so the padding of the strings is sent as such */
+		errno = 0;
+		new = calloc(1, sizeof(struct shared_list) + n * entry_size);
+		if (!new) {
+			print_error("calloc", errno);
+			return NULL;
+		}
+
+		client_list_lock();
+		if (count() <= n) {
+			new->refs = 1;
+			new->count = n;
+			return new;
+		}
+		free(new);
 	}
-	memset(players, 0, sz);
+	client_list_unlock();
+	return NULL;
+}
 
-	for (p = first_logged_client(), i = 0; p; p = next_logged_client()) {
-		if (p == client)
-			continue;
+/*
+ * Replaces *list with new, built with count entries from the players version
+ * the build started at, unless a later build has replaced it already, and
+ * unlocks the client list. A list built while the players changed is stale
+ * as soon as it is published.
+ */
+static void publish_list(struct shared_list **list, struct shared_list *new,
+		unsigned int count, unsigned long version)
+{
+	struct shared_list *old = *list;
 
+	new->count = count;
+	new->version = version;
+	if (old && old->version > version)
+		old = new;
+	else
+		*list = new;
+	client_list_unlock();
+
+	put_list(old);
+}
+
+/*
+ * Returns the logged in client following p in a walk of the list by a build,
+ * which lets the other threads take the client list every
+ * LIST_SNAPSHOT_CHUNK steps: the walk resumes from the username of the next
+ * client, which may be gone meanwhile.
+ */
+static struct game_client *snapshot_next(struct game_client *p,
+		unsigned int *steps)
+{
+	char key[MAX_USERNAME_SIZE];
+
+	if (!(p = next_logged_client(p)) || ++*steps % LIST_SNAPSHOT_CHUNK)
+		return p;
+
+	strcpy(key, p->folded_name);
+	client_list_unlock();
+	sched_yield();
+	client_list_lock();
+	return first_logged_client_from(key);
+}
+
+static size_t who_list_size(void)
+{
+	return logged_client_count();
+}
+
+/*
+ * Rebuilds the list of the players if it is stale. The entries are allocated
+ * without the client list locked, which is held only to copy them, a chunk
+ * at a time. The players logged in during the build beyond the room of the
+ * list are left to the next build.
+ */
+static void build_who_list(void)
+{
+	unsigned int i, steps;
+	unsigned long version;
+	struct game_client *p;
+	struct shared_list *list;
+	struct who_player *players;
+
+	if (!(list = alloc_list(&who_list, sizeof(struct who_player),
+					who_list_size)))
+		return;
+	players = (struct who_player *)list->entries;
+	version = players_version();
+
+	for (p = first_logged_client(), i = steps = 0; p && i < list->count;
+			p = snapshot_next(p, &steps)) {
 		strncpy(players[i].username, p->username, MAX_USERNAME_SIZE);
 		players[i].username[MAX_USERNAME_LENGTH] = '\0';
 
@@ -167,58 +349,256 @@ static void send_client_list(struct game_client *client)
 						MAX_USERNAME_SIZE);
 			players[i].opponent[MAX_USERNAME_LENGTH] = '\0';
 		}
-		i++;
+		p->who_slot = i++;
+	}
+
+	publish_list(&who_list, list, i, version);
+}
+
+/*
+ * Rebuilds the list of the matches if it is stale, as build_who_list(): the
+ * matches are taken from the walk of the players, each one at its first
+ * player, since the registry of the matches can't be walked in chunks.
+ */
+static void build_match_list(void)
+{
+	unsigned int i, steps;
+	unsigned long version;
+	struct game_client *p;
+	struct match *m;
+	struct shared_list *list;
+	struct match_entry *entries;
+
+	if (!(list = alloc_list(&match_list, sizeof(struct match_entry),
+					match_count)))
+		return;
+	entries = (struct match_entry *)list->entries;
+	version = players_version();
+
+	for (p = first_logged_client(), i = steps = 0; p && i < list->count;
+			p = snapshot_next(p, &steps)) {
+		if (!(m = p->match) || m->player1 != p)
+			continue;
+		entries[i].id = m->id;
+		strncpy(entries[i].player1, m->player1->username,
+				MAX_USERNAME_SIZE);
+		entries[i].player1[MAX_USERNAME_LENGTH] = '\0';
+		strncpy(entries[i].player2, m->player2->username,
+				MAX_USERNAME_SIZE);
+		entries[i].player2[MAX_USERNAME_LENGTH] = '\0';
+		entries[i++].status = m->awaiting_reply ?
+			PLAYER_AWAITING_REPLY : PLAYER_IN_GAME;
 	}
 
-send_free_and_exit:
-	send_ans_who(client->sock, players, count);
-	if (players)
-		free(players);
+	publish_list(&match_list, list, i, version);
+}
+
+/*
+ * Returns the index of the entry of client in the list of the players, or -1
+ * if it isn't there: it may have logged in after the list was built. The slot
+ * left by the last build is tried first; a build that wasn't published may
+ * have moved it, so the list, sorted by folded username, is searched then.
+ * Must be called with the client list locked.
+ */
+static int who_list_slot(struct shared_list *list, struct game_client *client)
+{
+	struct who_player *players = (struct who_player *)list->entries;
+	char folded[MAX_USERNAME_SIZE];
+	unsigned int lo, hi, mid;
+	int cmp;
+
+	if (!logged_in(client))
+		return -1;
+	if (client->who_slot < list->count &&
+			!strcmp(players[client->who_slot].username,
+				client->username))
+		return client->who_slot;
+
+	for (lo = 0, hi = list->count; lo < hi;) {
+		mid = lo + (hi - lo) / 2;
+		fold_username(folded, players[mid].username);
+		if (!(cmp = strcmp(folded, client->folded_name)))
+			return mid;
+		if (cmp < 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return -1;
+}
+
+/*
+ * Sends the last list of the players built, even if it has gone stale
+ * meanwhile. The client list is locked only to take a reference to it.
+ */
+static void send_client_list(struct game_client *client)
+{
+	struct shared_list *list;
+	int skip = -1;
+
+	client_list_lock();
+	if ((list = get_list(who_list)))
+		skip = who_list_slot(list, client);
+	client_list_unlock();
+
+	if (!list) {
+		send_ans_who(client->sock, NULL, 0);
+		return;
+	}
+	send_ans_who_shared(client->sock, (struct who_player *)list->entries,
+			list->count, skip);
+	put_list(list);
+}
+
+/* as send_client_list(), with the list of the matches */
+static void send_match_list(struct game_client *client)
+{
+	struct shared_list *list;
+
+	client_list_lock();
+	list = get_list(match_list);
+	client_list_unlock();
+
+	if (!list) {
+		send_ans_matches(client->sock, NULL, 0);
+		return;
+	}
+	send_ans_matches_shared(client->sock,
+			(struct match_entry *)list->entries, list->count);
+	put_list(list);
+}
+
+/*
+ * Serves a request of a client for a shared list: if the list is stale, it
+ * is rebuilt by build in a worker, if any, and the requests of the client
+ * that follow wait until the worker is done. The answer is sent by send in
+ * the thread owning the client.
+ */
+static void serve_list(struct game_client *client, struct shared_list **list,
+		void (*build)(void), void (*send)(struct game_client *))
+{
+	bool fresh;
+
+	client_list_lock();
+	fresh = list_fresh(*list);
+	client_list_unlock();
+
+	if (!fresh) {
+		if (WORKER_THREADS > 0 &&
+				workpool_submit(&workers, build, client)) {
+			client->answer = send;
+			client->busy = true;
+			reactor_update_interest(client->owner, client);
+			return;
+		}
+		build();
+	}
+	send(client);
 }
 
 static void do_login(struct game_client *client, struct req_login *msg)
 {
 	enum login_response res;
 
-	if (!valid_username(msg->username)) {
-		printf("Client on socket %d sent an invalid username: %s\n",
-				client->sock, msg->username);
+	/* the username is the key of the client in the list: it can't change
+	 * while the client is in it */
+	if (logged_in(client)) {
+		res = LOGIN_ALREADY_LOGGED_IN;
+	} else if (!valid_username(msg->username)) {
 		res = LOGIN_INVALID_NAME;
-	} else if (!unique_username(msg->username)) {
-		printf("Client on socket %d sent an username already in use: %s\n",
-				client->sock, msg->username);
-		res = LOGIN_NAME_INUSE;
 	} else {
-		login_client(client, msg->username, msg->udp_port);
-		printf("Client on socket %d is now logged in as: %s\n",
-				client->sock, client->username);
-		res = LOGIN_OK;
+		client_list_lock();
+		res = unique_username(msg->username) ? LOGIN_OK :
+			LOGIN_NAME_INUSE;
+		if (res == LOGIN_OK)
+			login_client(client, msg->username, msg->udp_port);
+		client_list_unlock();
 	}
 
+	if (res == LOGIN_ALREADY_LOGGED_IN)
+		reactor_log("Client on socket %d is already logged in as: %s\n",
+				client->sock, client->username);
+	else if (res == LOGIN_INVALID_NAME)
+		reactor_log("Client on socket %d sent an invalid username: %s\n",
+				client->sock, msg->username);
+	else if (res == LOGIN_NAME_INUSE)
+		reactor_log("Client on socket %d sent an username already in use: %s\n",
+				client->sock, msg->username);
+	else
+		reactor_log("Client on socket %d is now logged in as: %s\n",
+				client->sock, client->username);
+
 	send_ans_login(client->sock, res);
 }
 
 /*
- * Dispatches a message to the correct function.
+ * Takes a token from the request bucket of a client, refilled at
+ * REQUEST_RATE tokens per second up to REQUEST_BURST. Returns false if the
+ * bucket is empty, i.e. the client is sending too many requests.
  */
-static bool dispatch_message(struct game_client *client)
+static bool take_request_token(struct game_client *client)
 {
-	struct message *msg;
-	bool noblock;
+	uint64_t now = client->owner->now;
+	double elapsed;
 
-	msg = read_message_async(client->sock, &noblock);
-	if (!noblock)
-		return true;
-	if (!msg)
+	elapsed = (now - client->tokens_time) / 1e3;
+	client->tokens_time = now;
+
+	client->tokens += elapsed * REQUEST_RATE;
+	if (client->tokens > REQUEST_BURST)
+		client->tokens = REQUEST_BURST;
+
+	if (client->tokens < 1)
 		return false;
+	client->tokens--;
+	return true;
+}
 
+/*
+ * Dispatches a message to the correct function. The requests that make the
+ * server do some work are rate limited: over the limit, they are answered
+ * with ANS_BUSY. The client list is locked only by the requests that use the
+ * registries of the usernames and of the matches, shared by all the threads.
+ */
+static void dispatch_message(struct game_client *client, struct message *msg)
+{
 	switch (msg->header.type) {
 	case REQ_LOGIN:
-		do_login(client, (struct req_login *)msg);
+	case REQ_WHO:
+	case REQ_MATCHES:
+	case REQ_PLAY:
+		if (!take_request_token(client)) {
+			send_ans_busy(client->sock);
+			return;
+		}
 		break;
+	default:
+		break;
+	}
+
+	switch (msg->header.type) {
+	case REQ_LOGIN:
+		do_login(client, (struct req_login *)msg);
+		return;
 	case REQ_WHO:
-		send_client_list(client);
+		serve_list(client, &who_list, build_who_list,
+				send_client_list);
+		return;
+	case REQ_MATCHES:
+		serve_list(client, &match_list, build_match_list,
+				send_match_list);
+		return;
+	case REQ_PLAY:
+	case REQ_PLAY_ANS:
+	case MSG_ENDGAME:
 		break;
+	default:
+		send_ans_badreq(client->sock);
+		return;
+	}
+
+	client_list_lock();
+	switch (msg->header.type) {
 	case REQ_PLAY:
 		process_play_request(client, (struct req_play *)msg);
 		break;
@@ -231,144 +611,552 @@ static bool dispatch_message(struct game_client *client)
 				((struct msg_endgame *)msg)->disconnected);
 		break;
 	default:
-		send_ans_badreq(client->sock);
+		break;
+	}
+	client_list_unlock();
+}
+
+/*
+ * Dispatches the complete messages found in the len bytes pointed by buf,
+ * stopping early if too much output is already queued for the client: the
+ * rest is resumed once the output has been flushed. No more than the
+ * dispatch budget is consumed: the rest is left for the next iterations.
+ * Returns the number of bytes consumed, or -1 on error.
+ */
+static ssize_t dispatch_messages(struct game_client *client, char *buf,
+		size_t len)
+{
+	struct message *msg;
+	size_t done;
+	unsigned int count;
+
+	for (done = 0, count = 0; done < len; count++,
+			done += sizeof(struct msg_header) + msg->header.length) {
+		if (client->busy)
+			break;
+		if (CLIENT_OUTPUT_LENGTH(client) > OUTPUT_HIGH_WATER_MARK) {
+			client->stalled = true;
+			break;
+		}
+		if (count >= DISPATCH_MESSAGE_BUDGET ||
+				done >= DISPATCH_BYTE_BUDGET) {
+			if (!reactor_defer_input(client->owner, client))
+				return -1;
+			break;
+		}
+		if (!parse_message(client->sock, buf + done, len - done,
+					&msg))
+			return -1;
+		if (!msg)
+			break;
+		dispatch_message(client, msg);
 	}
 
-	delete_message(msg);
+	return done;
+}
+
+/*
+ * Dispatches the complete messages stored in the input buffer of a client,
+ * leaving a trailing partial message in it. Returns false on error.
+ */
+static bool dispatch_input_buffer(struct game_client *client)
+{
+	struct buffer *in = &client->inbuf;
+	ssize_t done;
+
+	done = dispatch_messages(client, BUFFER_DATA(in), BUFFER_LENGTH(in));
+	if (done == -1)
+		return false;
+	buffer_consume(in, done);
+
+	if (!client->stalled && !client->pending && !client->busy &&
+			BUFFER_LENGTH(in) > MAX_INPUT_BUFFER_SIZE) {
+		printf_error("dispatch_input_buffer: message too long from socket %d",
+				client->sock);
+		return false;
+	}
 	return true;
 }
 
 /*
- * Accepts a new incoming connection.
+ * Reads the bytes available on the socket of a client in its input buffer,
+ * with a single recv() filling as much of the buffer as possible. Returns the
+ * number of bytes read, 0 if the peer has closed the connection or -errno on
+ * error.
  */
-static int accept_connection(int sockfd)
+static ssize_t read_client_data(struct game_client *client)
 {
-	int connfd;
-	struct sockaddr_storage addr;
+	struct buffer *in = &client->inbuf;
+	ssize_t received;
+	char *dst;
+
+	if (!(dst = buffer_reserve(in, INPUT_READ_SIZE)))
+		return -ENOMEM;
+
+	errno = 0;
+	received = recv(client->sock, dst, in->size - in->end, 0);
+	if (received == -1)
+		return -errno;
+
+	buffer_commit(in, received);
+	return received;
+}
+
+/*
+ * Processes the bytes received from a client by the poller, in the provided
+ * buffer data. Complete messages are dispatched directly from data; only a
+ * trailing partial message is copied in the input buffer of the client,
+ * waiting for the rest of it. Returns false on error.
+ */
+static bool receive_data(struct game_client *client, char *data, size_t len)
+{
+	struct buffer *in = &client->inbuf;
+	ssize_t done;
+
+	if (BUFFER_LENGTH(in) > 0) {
+		if (!buffer_append(in, data, len))
+			return false;
+		return dispatch_input_buffer(client);
+	}
+
+	if (-1 == (done = dispatch_messages(client, data, len)))
+		return false;
+	if (!buffer_append(in, data + done, len - done))
+		return false;
+
+	if (!client->stalled && !client->pending && !client->busy &&
+			BUFFER_LENGTH(in) > MAX_INPUT_BUFFER_SIZE) {
+		printf_error("receive_data: message too long from socket %d",
+				client->sock);
+		return false;
+	}
+	return true;
+}
+
+static void print_disconnection(struct game_client *client)
+{
+	if (logged_in(client))
+		reactor_log("Player %s has closed the connection on socket %d\n",
+				client->username, client->sock);
+	else
+		reactor_log("The remote host has closed the connection on socket %d\n",
+				client->sock);
+}
+
+/*
+ * Serves an event on the socket of a client owned by r: the queued output is
+ * flushed, the received bytes are parsed and the complete messages
+ * dispatched. Returns false if the connection must be closed.
+ */
+static bool serve_client(struct reactor *r, struct game_client *client,
+		struct poller_event *ev)
+{
+	ssize_t received;
+	bool ok;
+
+	if (ev->events & POLLER_OUT) {
+		if (!reactor_flush(r, client))
+			return false;
+		/* resume the requests left in the buffer */
+		if (client->stalled && !client->throttled) {
+			client->stalled = false;
+			if (!dispatch_input_buffer(client))
+				return false;
+		}
+	}
+
+	if (ev->events & POLLER_RECV)
+		received = ev->result;
+	else if (ev->events & (POLLER_IN | POLLER_HUP))
+		received = read_client_data(client);
+	else
+		return true;
+
+	if (received == -EAGAIN || received == -EWOULDBLOCK ||
+			received == -EINTR)
+		return true;
+	if (received < 0)
+		print_error("recv", -received);
+	if (received <= 0) {
+		print_disconnection(client);
+		return false;
+	}
+
+	if (ev->events & POLLER_RECV)
+		ok = receive_data(client, ev->data, received);
+	else
+		ok = dispatch_input_buffer(client);
+
+	if (!ok)
+		printf_error("serve_client: error. Closing connection socket %d",
+				client->sock);
+	return ok;
+}
+
+/*
+ * Closes the connection of a client owned by r. The client is forgotten with
+ * the client list locked: once it is removed, the other threads can't find it
+ * and post messages to it anymore.
+ */
+static void close_client(struct reactor *r, struct game_client *client)
+{
+	int fd = client->sock;
+
+	client_list_lock();
+	terminate_match(client, true);
+	if (client->busy)
+		workpool_forget(&workers, client);
+	reactor_forget(r, client);
+	remove_client(client);
+	client_list_unlock();
+
+	poller_remove(r->poller, fd);
+	close(fd);
+}
+
+/*
+ * Checks the connection caps: max_clients connected clients in total and
+ * MAX_CLIENTS_PER_ADDRESS from the same address (0 for no limit), which does
+ * not apply to the local connections. Must be called with the client list
+ * locked.
+ */
+static bool admit_connection(struct sockaddr_storage *addr, bool local)
+{
+	if (max_clients > 0 && connected_client_count() >= max_clients)
+		return false;
+	if (local)
+		return true;
+#if defined(USE_IPV6_ADDRESSING) && USE_IPV6_ADDRESSING == 1
+	if (MAX_CLIENTS_PER_ADDRESS > 0 && address_client_count(
+			((struct sockaddr_in6 *)addr)->sin6_addr) >=
+			MAX_CLIENTS_PER_ADDRESS)
+		return false;
+#else
+	if (MAX_CLIENTS_PER_ADDRESS > 0 && address_client_count(
+			((struct sockaddr_in *)addr)->sin_addr) >=
+			MAX_CLIENTS_PER_ADDRESS)
+		return false;
+#endif
+	return true;
+}
+
+/*
+ * Answers ANS_BUSY to a connection over the caps and closes it. The request
+ * already received, if any, is discarded first: closing a socket with unread
+ * data resets the connection and the answer would be lost.
+ */
+static void refuse_connection(int connfd)
+{
+	char discard[256];
+
+	send_ans_busy(connfd);
+	shutdown(connfd, SHUT_WR);
+	while (recv(connfd, discard, sizeof(discard), 0) > 0)
+		;
+	close(connfd);
+}
+
+/*
+ * Fills addr with the loopback address, given to the clients connected on
+ * the AF_UNIX socket: they run on the same host of the server, so this is
+ * the address where the opponents on that host can reach them. The remote
+ * opponents are given the address of the server (see
+ * send_ans_play_opponent()).
+ */
+static void local_address(struct sockaddr_storage *addr)
+{
+#if defined(USE_IPV6_ADDRESSING) && USE_IPV6_ADDRESSING == 1
+	fill_sockaddr(addr, in6addr_loopback, 0);
+#else
+	struct in_addr loopback;
+
+	loopback.s_addr = htonl(INADDR_LOOPBACK);
+	fill_sockaddr(addr, loopback, 0);
+#endif
+}
+
+/*
+ * Registers a new connection, accepted on a listening socket of r, as a
+ * client owned by r. local is true for connections on the AF_UNIX socket.
+ */
+static void add_connection(struct reactor *r, int connfd,
+		struct sockaddr_storage *addr, bool local)
+{
+	struct game_client *client;
 	char ipstr[ADDRESS_STRING_LENGTH];
 	in_port_t port;
 
-	if (-1 == (connfd = accept_socket_connection(sockfd, &addr)))
-		return -1;
+	if (local)
+		local_address(addr);
 
+	client_list_lock();
+	if (!admit_connection(addr, local)) {
+		refuse_connection(connfd);
+		client_list_unlock();
+		reactor_log("Connection refused: too many clients (socket: %d)\n",
+				connfd);
+		return;
+	}
 #if defined(USE_IPV6_ADDRESSING) && USE_IPV6_ADDRESSING == 1
-	add_client(((struct sockaddr_in6 *)&addr)->sin6_addr, connfd);
+	client = add_client(((struct sockaddr_in6 *)addr)->sin6_addr, local,
+			connfd, r);
 #else
-	add_client(((struct sockaddr_in *)&addr)->sin_addr, connfd);
+	client = add_client(((struct sockaddr_in *)addr)->sin_addr, local,
+			connfd, r);
 #endif
+	client_list_unlock();
 
-	if (get_peer_address(connfd, ipstr, ADDRESS_STRING_LENGTH, &port))
-		printf("Incoming connection from %s:%d (socket: %d)\n",
+	if (!poller_add(r->poller, connfd, POLLER_RECV)) {
+		client_list_lock();
+		remove_client(client);
+		client_list_unlock();
+		close(connfd);
+		return;
+	}
+	client->poll_events = POLLER_RECV;
+
+	if (local)
+		reactor_log("Incoming local connection (socket: %d)\n", connfd);
+	else if (get_peer_address(connfd, ipstr, ADDRESS_STRING_LENGTH,
+				&port))
+		reactor_log("Incoming connection from %s:%d (socket: %d)\n",
 				ipstr, port, connfd);
 
-	return connfd;
+	/* with TCP_DEFER_ACCEPT the connection surfaces when the login request
+	 * has arrived: serve it now instead of at the next iteration */
+	if (DEFER_ACCEPT_SECONDS > 0 && !local) {
+		struct poller_event ev = {connfd, POLLER_IN, 0, NULL};
+
+		if (!serve_client(r, client, &ev))
+			close_client(r, client);
+	}
 }
 
 /*
- * Server main cycle.
+ * Accepts the pending connections on the listening socket sfd of r, up to
+ * ACCEPT_BUDGET: the remaining ones are reported again by the poller at the
+ * next iteration, after the other descriptors have been served.
  */
-static void go_server(int sfd)
+static void accept_connections(struct reactor *r, int sfd)
 {
-	fd_set readfds, _readfds;
-	int nfds;
+	struct sockaddr_storage addr;
+	int connfd, i;
 
-	FD_ZERO(&readfds);
-	FD_SET(sfd, &readfds);
-	nfds = sfd;
+	for (i = 0; i < ACCEPT_BUDGET; i++) {
+		if (-1 == (connfd = accept_socket_connection(sfd, &addr)))
+			return;
+		add_connection(r, connfd, &addr, sfd == r->usfd);
+	}
+}
 
-	client_list_init();
+/*
+ * Registers a connection already accepted by the poller on the listening
+ * socket sfd.
+ */
+static void accept_connection(struct reactor *r, int sfd, int connfd)
+{
+	struct sockaddr_storage addr;
+	socklen_t len;
 
-	for (;;) {
-		int fd, ready;
-		struct timeval timeout;
+	if (sfd == r->usfd) {
+		add_connection(r, connfd, &addr, true);
+		return;
+	}
 
-		if (received_signal > 0) {
-			client_list_destroy();
-			close_range(sfd + 1, nfds);
-			return;
+	len = sizeof(struct sockaddr_storage);
+	errno = 0;
+	if (getpeername(connfd, (struct sockaddr *)&addr, &len) == -1) {
+		print_error("getpeername", errno);
+		close(connfd);
+		return;
+	}
+
+	add_connection(r, connfd, &addr, false);
+}
+
+/*
+ * Raises the limit of open file descriptors to the hard limit, so that the
+ * number of connected clients is not capped by the (usually low) soft limit,
+ * then lowers max_clients to fit in the limit: a server out of descriptors
+ * can't even accept the connections to refuse them.
+ */
+static void raise_fd_limit()
+{
+	struct rlimit rl;
+
+	max_clients = MAX_CLIENTS;
+
+	errno = 0;
+	if (getrlimit(RLIMIT_NOFILE, &rl) == -1) {
+		print_error("getrlimit", errno);
+		return;
+	}
+	if (rl.rlim_cur != rl.rlim_max) {
+		rl.rlim_cur = rl.rlim_max;
+		if (setrlimit(RLIMIT_NOFILE, &rl) == -1) {
+			print_error("setrlimit", errno);
+			if (getrlimit(RLIMIT_NOFILE, &rl) == -1)
+				return;
 		}
+	}
+
+	if (rl.rlim_cur == RLIM_INFINITY || rl.rlim_cur <= RESERVED_FDS)
+		return;
+	if (max_clients == 0 || rl.rlim_cur - RESERVED_FDS < max_clients) {
+		max_clients = rl.rlim_cur - RESERVED_FDS;
+		printf("Clients capped at %u by the limit of open files\n",
+				max_clients);
+	}
+}
+
+/*
+ * Returns the number of reactor threads to start.
+ */
+static unsigned int reactor_count()
+{
+	long n;
+
+	if (REACTOR_THREADS > 0)
+		return REACTOR_THREADS;
+
+	n = sysconf(_SC_NPROCESSORS_ONLN);
+	return (n > 0) ? (unsigned int)n : 1;
+}
+
+/*
+ * Prints the occupancy of the allocation pools and the clients by address (on
+ * SIGUSR1).
+ */
+static void print_pool_stats(void *arg)
+{
+	unsigned int i;
 
-		_readfds = readfds;
+	(void)arg;
 
-		timeout.tv_sec = SELECT_TIMEOUT_SECONDS;
-		timeout.tv_usec = 0;
+	client_list_lock();
+	print_game_pool_stats();
+	print_address_stats();
+	client_list_unlock();
 
+	for (i = 0; i < reactor_count(); i++)
+		mailbox_print_stats(&reactors[i].mailbox);
+	fflush(stdout);
+}
+
+/*
+ * Server main cycle, run by every reactor thread. The first reactor also
+ * receives the signals and checks the play requests for timeouts. A reactor
+ * waits for events with no timeout while there is nothing to do.
+ */
+static void *go_server(void *arg)
+{
+	struct reactor *r = arg;
+	struct poller_event events[POLLER_MAX_EVENTS];
+	int timeout = -1;
+
+	set_current_reactor(r);
+
+	while (!reactor_stopping(r)) {
+		int i, ready;
+		size_t n;
+
+		/* don't wait while some input or deferred work is left over */
 		errno = 0;
-		ready = select(nfds + 1, &_readfds, NULL, NULL, &timeout);
+		ready = poller_wait(r->poller, events, POLLER_MAX_EVENTS,
+				(r->pending_count > 0 || r->deferred_count > 0) ?
+				0 : timeout);
+		r->now = timer_clock();
 
 		if (ready == -1 && errno == EINTR) {
-			client_list_destroy();
-			close_range(sfd + 1, nfds);
-			return;
+			continue;
 		} else if (ready == -1) {
-			print_error("select", errno);
+			print_error("epoll_wait", errno);
 			break;
 		}
 
-		remove_elapsed_matches();
+		for (i = 0; i < ready; i++) {
+			struct game_client *client;
+			int fd = events[i].fd;
 
-		for (fd = 0; fd <= nfds; fd++) {
-			struct game_client *client = NULL;
+			if (fd == r->sfd || fd == r->usfd) {
+				int res = events[i].result;
 
-			if (!FD_ISSET(fd, &_readfds))
+				if (!(events[i].events & POLLER_ACCEPT))
+					accept_connections(r, fd);
+				else if (res < 0)
+					print_error("accept", -res);
+				else
+					accept_connection(r, fd, res);
 				continue;
+			}
 
-			if (fd == sfd) {
-				int connfd;
+			if (fd == MAILBOX_FD(&r->mailbox)) {
+				reactor_deliver_mail(r);
+				continue;
+			}
 
-				if (-1 == (connfd = accept_connection(sfd)))
-					continue;
+			if (fd == r->sigfd) {
+				int signum = sighandler_read(fd);
 
-				FD_SET(connfd, &readfds);
-				nfds = (connfd > nfds) ? connfd : nfds;
+				if (signum == SIGUSR1)
+					reactor_defer_work(r,
+						print_pool_stats, NULL);
+				else if (signum)
+					reactor_stop(r);
 				continue;
 			}
 
-			client = get_client_by_socket(fd);
-			assert(client);
-
-#define	CLOSE_CLIENT	do {\
-		close(fd);\
-		FD_CLR(fd, &readfds);\
-		terminate_match(client, true);\
-		remove_client(client);\
-		if (fd >= nfds) {\
-			nfds = get_max_fd();\
-			nfds = (sfd > nfds) ? sfd : nfds;\
-		}\
-	} while(0)
-
-			if (!bytes_available(fd)) {
-				if (logged_in(client))
-					printf("Player %s has closed the connection on socket %d\n",
-							client->username,
-							client->sock);
-				else
-					printf("The remote host has closed the connection on socket %d\n",
-							client->sock);
-				CLOSE_CLIENT;
+			/* with io_uring a batch may carry more events for a
+			 * client closed by an earlier one */
+			if (!(client = reactor_client(r, fd)))
 				continue;
-			}
 
-			if (!dispatch_message(client)) {
-				printf_error("dispatch_message: error. Closing connection socket %d",
-						client->sock);
-				CLOSE_CLIENT;
-			}
+			if (!serve_client(r, client, &events[i]))
+				close_client(r, client);
+		}
+
+		/* continue with the clients left over by the dispatch budget,
+		 * in the order they have been queued */
+		for (n = r->pending_count; n > 0; n--) {
+			struct game_client *client = reactor_next_pending(r);
+
+			if (!client)
+				continue;
+			if (!dispatch_input_buffer(client))
+				close_client(r, client);
+			else if (!client->pending)
+				reactor_update_interest(r, client);
+		}
+
+		if (r->id == 0) {
+			client_list_lock();
+			timer_wheel_advance(&match_timers, r->now);
+			timeout = timer_wheel_timeout(&match_timers, r->now);
+			client_list_unlock();
 		}
+
+		/* write all the responses of this iteration at once */
+		reactor_flush_dirty(r);
+
+		/* the rest is not needed by the responses */
+		reactor_run_deferred_work(r, false);
 	}
+	reactor_run_deferred_work(r, true);
 
-	print_error("go_server: error. exiting...", 0);
-	client_list_destroy();
-	close_range(sfd + 1, nfds);
-	close(sfd);
-	exit(EXIT_FAILURE);
+	if (!reactor_stopping(r)) {
+		print_error("go_server: error. exiting...", 0);
+		kill(getpid(), SIGTERM);
+	}
+	return NULL;
 }
 
 int main(int argc, char **argv)
 {
-	int sfd;
+	unsigned int i, n, opened, inited, started, joined;
+	struct game_client *client;
 	uint16_t port;
+	int sigfd, fd;
+	int status, usfd;
 
 	if (argc > 2) {
 		printf("Usage: %s <port>\n", argv[0]);
@@ -383,21 +1171,101 @@ int main(int argc, char **argv)
 			exit(EXIT_FAILURE);
 		}
 
-	sfd = listen_on_port(htons(port));
-	if (sfd < 0)
+	raise_fd_limit();
+
+	/* signals are blocked in every thread and received by the first
+	 * reactor through a signalfd */
+	if (!sighandler_block(NULL) || -1 == (sigfd = sighandler_fd()))
 		exit(EXIT_FAILURE);
 
-	if (!sighandler_init()) {
-		close(sfd);
+	n = reactor_count();
+	errno = 0;
+	reactors = calloc(n, sizeof(struct reactor));
+	if (!reactors) {
+		print_error("calloc", errno);
 		exit(EXIT_FAILURE);
 	}
 
-	printf("Server listening on port %hu\n", port);
+	client_list_init();
+	if (!prefault_game_pools(PREFAULT_CLIENTS, PREFAULT_MATCHES))
+		exit(EXIT_FAILURE);
+	timer_wheel_init(&match_timers, timer_clock());
+	if (WORKER_THREADS > 0 && !workpool_init(&workers, WORKER_THREADS))
+		exit(EXIT_FAILURE);
+
+	/* the AF_UNIX socket is taken only once the TCP port is ours, after
+	 * the retries of listen_on_port() */
+	status = EXIT_SUCCESS;
+	for (opened = 0; opened < n; opened++) {
+		reactors[opened].sfd = listen_on_port(htons(port), n > 1,
+				DEFER_ACCEPT_SECONDS);
+		if (reactors[opened].sfd < 0) {
+			status = EXIT_FAILURE;
+			break;
+		}
+	}
+
+	usfd = -1;
+	if (status == EXIT_SUCCESS && *UNIX_SOCKET_PATH &&
+			-1 == (usfd = listen_on_unix_socket(UNIX_SOCKET_PATH)))
+		status = EXIT_FAILURE;
+
+	/* all the reactors are initialized before any of them starts, since
+	 * each one looks for clients among those of the others */
+	for (inited = 0; status == EXIT_SUCCESS && inited < n; inited++)
+		if (!reactor_init(&reactors[inited], inited,
+					reactors[inited].sfd, usfd,
+					inited == 0 ? sigfd : -1)) {
+			status = EXIT_FAILURE;
+			break;
+		}
+	for (started = 0; status == EXIT_SUCCESS && started < n; started++)
+		if (!reactor_start(&reactors[started], go_server)) {
+			status = EXIT_FAILURE;
+			break;
+		}
 
-	go_server(sfd);
+	if (status == EXIT_SUCCESS) {
+		printf("Server listening on port %hu (%u threads)\n", port, n);
+		if (usfd != -1)
+			printf("Server listening on %s\n", UNIX_SOCKET_PATH);
+		/* the first reactor returns when a signal is received */
+		reactor_join(&reactors[0]);
+		puts("\nExiting...");
+		joined = 1;
+	} else {
+		joined = 0;
+	}
 
-	puts("\nExiting...");
+	for (i = joined; i < started; i++)
+		reactor_stop(&reactors[i]);
+	for (i = joined; i < started; i++)
+		reactor_join(&reactors[i]);
+	if (WORKER_THREADS > 0)
+		workpool_destroy(&workers);
+
+	for (i = 0; i < inited; i++)
+		for (fd = -1; (client = fdtable_next(&reactors[i].clients,
+						&fd));) {
+			close(client->sock);
+			remove_client(client);
+		}
+	client_list_destroy();
+	destroy_game_pools();
+	put_list(who_list);
+	put_list(match_list);
+
+	for (i = 0; i < inited; i++)
+		reactor_destroy(&reactors[i]);
+	for (i = 0; i < opened; i++)
+		close(reactors[i].sfd);
+	free(reactors);
+
+	if (usfd != -1) {
+		close(usfd);
+		unlink(UNIX_SOCKET_PATH);
+	}
+	close(sigfd);
 
-	close(sfd);
-	exit(EXIT_SUCCESS);
+	exit(status);
 }
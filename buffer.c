@@ -0,0 +1,109 @@
+/*
+ * This file is part of reti2016.
+ *
+ * reti2016 is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * reti2016 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * See file LICENSE for more details.
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include "buffer.h"
+#include "console.h"
+
+/* smallest allocation made for a buffer */
+#define	BUFFER_MIN_SIZE		512
+
+void buffer_free(struct buffer *buf)
+{
+	if (buf->data)
+		free(buf->data);
+	BUFFER_INIT(buf);
+}
+
+/*
+ * Makes room for at least len more bytes at the end of the buffer, moving the
+ * stored bytes to the beginning or growing the allocation when needed.
+ * Returns a pointer to the free space, or NULL if the allocation fails.
+ */
+char *buffer_reserve(struct buffer *buf, size_t len)
+{
+	size_t stored, size;
+	char *data;
+
+	if (buf->size - buf->end >= len)
+		return buf->data + buf->end;
+
+	stored = BUFFER_LENGTH(buf);
+	if (buf->size - stored >= len) {
+		memmove(buf->data, BUFFER_DATA(buf), stored);
+		buf->start = 0;
+		buf->end = stored;
+		return buf->data + buf->end;
+	}
+
+	for (size = buf->size ? buf->size : BUFFER_MIN_SIZE;
+			size - stored < len; size *= 2)
+		;
+
+	errno = 0;
+	data = malloc(size);
+	if (!data) {
+		print_error("malloc", errno);
+		return NULL;
+	}
+	if (stored)
+		memcpy(data, BUFFER_DATA(buf), stored);
+	if (buf->data)
+		free(buf->data);
+
+	buf->data = data;
+	buf->size = size;
+	buf->start = 0;
+	buf->end = stored;
+	return buf->data + buf->end;
+}
+
+/*
+ * Marks len bytes, previously written in the space returned by
+ * buffer_reserve(), as stored.
+ */
+void buffer_commit(struct buffer *buf, size_t len)
+{
+	buf->end += len;
+}
+
+bool buffer_append(struct buffer *buf, const void *src, size_t len)
+{
+	char *dst;
+
+	if (!len)
+		return true;
+
+	dst = buffer_reserve(buf, len);
+	if (!dst)
+		return false;
+
+	memcpy(dst, src, len);
+	buffer_commit(buf, len);
+	return true;
+}
+
+/*
+ * Discards the first len stored bytes.
+ */
+void buffer_consume(struct buffer *buf, size_t len)
+{
+	buf->start += len;
+	if (buf->start >= buf->end)
+		buf->start = buf->end = 0;
+}
@@ -15,70 +15,147 @@
  */
 
 #include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <arpa/inet.h>
 #include "client_list.h"
 #include "console.h"
 #include "hashtable.h"
-#include "list.h"
+#include "reactor.h"
+#include "skiplist.h"
 
 /*
- * The list contains all logged in (with username) clients, ordered
- * alphabetically; while the hashtable cointains all connected clients.
+ * The skiplist contains all logged in (with username) clients, ordered
+ * alphabetically by folded username, and address_hashtable counts the
+ * connected clients by network address. Both of them (and the matches
+ * between the clients) are shared by all the server threads and protected by
+ * client_list_mutex, as well as the changes to the tables of the clients
+ * owned by each reactor, indexed by socket (see struct reactor).
  */
-static struct list_head *client_list = NULL;
-static struct list_head client_hashtable[HASHTABLE_SIZE];
-static unsigned int logged_count;
+static pthread_mutex_t client_list_mutex = PTHREAD_MUTEX_INITIALIZER;
+static struct skiplist client_list;
+static bool initialized = false;
+static struct hashtable address_hashtable;
+static unsigned int connected_count;
+
+/* number of clients connected from the same address, the key of the
+ * hashtable */
+struct address_clients {
+#if defined(USE_IPV6_ADDRESSING) && USE_IPV6_ADDRESSING == 1
+	struct in6_addr address;
+#else
+	struct in_addr address;
+#endif
+	unsigned int count;
+};
+
+/*
+ * Returns the client containing a link of the skiplist, or NULL.
+ */
+static struct game_client *name_link_client(struct skiplist_link *link)
+{
+	return link ? SKIPLIST_ENTRY(link, struct game_client, name_link) : NULL;
+}
 
 /*
- * Allocates the necessary space for the list and the hashtable.
+ * Initializes the skiplist and the tables.
  */
 void client_list_init()
 {
-	if (client_list)
+	if (initialized)
 		return;
 
-	errno = 0;
-	client_list = malloc(sizeof(struct list_head));
-	if (!client_list) {
-		print_error("malloc", errno);
-		exit(EXIT_FAILURE);
-	}
-	logged_count = 0;
+	connected_count = 0;
 
-	LIST_INIT(client_list, TP_STR);
-	HASHTABLE_INIT(client_hashtable);
+	skiplist_init(&client_list);
+#if defined(USE_IPV6_ADDRESSING) && USE_IPV6_ADDRESSING == 1
+	HASHTABLE_INIT(&address_hashtable, sizeof(struct in6_addr));
+#else
+	HASHTABLE_INIT(&address_hashtable, sizeof(struct in_addr));
+#endif
+	initialized = true;
+}
+
+void client_list_lock()
+{
+	pthread_mutex_lock(&client_list_mutex);
+}
+
+void client_list_unlock()
+{
+	pthread_mutex_unlock(&client_list_mutex);
 }
 
 void remove_client(struct game_client *client)
 {
+	struct address_clients *ac;
+
 	if (logged_in(client)) {
-		list_remove(client_list, (void *)client->username);
-		logged_count--;
+		skiplist_remove(&client_list, &client->name_link);
+		client->who_slot = WHO_SLOT_NONE;
+		players_changed();
 	}
 
-	hashtable_remove(client_hashtable, client->sock);
+	ac = client->local ? NULL :
+		hashtable_search(&address_hashtable, &client->address);
+	if (ac && --ac->count == 0)
+		free(hashtable_remove(&address_hashtable, &client->address));
+
+	fdtable_remove(&client->owner->clients, client->sock);
+	connected_count--;
+	buffer_free(&client->inbuf);
+	buffer_free(&client->outbuf);
+	buffer_free(&client->bulkbuf);
 	delete_client(client);
 }
 
 /*
- * Creates a client (not logged in) and adds it to the hashtable.
+ * Creates a client (not logged in), owned by the reactor owner and added to
+ * its table, and counts it
+ * in the hashtable unless it is local, i.e. connected on the AF_UNIX socket:
+ * all the local clients share the loopback address, but they are not subject
+ * to the per-address cap.
  */
 #if defined(USE_IPV6_ADDRESSING) && USE_IPV6_ADDRESSING == 1
-void add_client(struct in6_addr address, int sockfd)
+struct game_client *add_client(struct in6_addr address, bool local,
+		int sockfd, struct reactor *owner)
 #else
-void add_client(struct in_addr address, int sockfd)
+struct game_client *add_client(struct in_addr address, bool local,
+		int sockfd, struct reactor *owner)
 #endif
 {
 	struct game_client *client;
+	struct address_clients *ac = NULL;
+
+	if (!local)
+		ac = hashtable_search(&address_hashtable, &address);
+	if (!local && !ac) {
+		errno = 0;
+		ac = malloc(sizeof(struct address_clients));
+		if (!ac) {
+			print_error("malloc", errno);
+			exit(EXIT_FAILURE);
+		}
+		ac->address = address;
+		ac->count = 0;
+		hashtable_insert(&address_hashtable, &ac->address, ac);
+	}
+	if (ac)
+		ac->count++;
 
 	client = create_client(NULL, 0, address, sockfd);
-	hashtable_insert(client_hashtable, client, &client->sock);
+	client->owner = owner;
+	client->local = local;
+	fdtable_insert(&owner->clients, client->sock, client);
+	connected_count++;
+	return client;
 }
 
 /*
- * Logins a client, adding an username and a port to it. It also adds the
- * client to the ordered list.
+ * Logins a client, adding a valid username and a port to it. It also adds
+ * the client to the ordered skiplist, by its username folded once here.
  */
 void login_client(struct game_client *client, const char *username,
 		in_port_t port)
@@ -86,39 +163,41 @@ void login_client(struct game_client *client, const char *username,
 	strncpy(client->username, username, MAX_USERNAME_SIZE);
 	client->username[MAX_USERNAME_LENGTH] = '\0';
 	client->port = port;
-	list_insert(client_list, client, (void *)client->username);
-	logged_count++;
+	fold_username(client->folded_name, client->username);
+	skiplist_insert(&client_list, &client->name_link, client->folded_name);
+	players_changed();
 }
 
 struct game_client *get_client_by_username(const char *username)
 {
-	return (struct game_client *)
-			list_search(client_list, (void *)username);
-}
+	char folded[MAX_USERNAME_SIZE];
 
-struct game_client *get_client_by_socket(int fd)
-{
-	return (struct game_client *)hashtable_search(client_hashtable, fd);
+	if (!fold_username(folded, username))
+		return NULL;
+	return name_link_client(skiplist_search(&client_list, folded));
 }
 
 struct game_client *first_logged_client()
 {
-	return (struct game_client *)list_first(client_list);
+	return name_link_client(skiplist_first(&client_list));
 }
 
-struct game_client *next_logged_client()
-{
-	return (struct game_client *)list_next(client_list);
-}
-
-static struct game_client *first_client()
+/*
+ * Returns the first logged in client whose folded username is folded or
+ * follows it, or NULL.
+ */
+struct game_client *first_logged_client_from(const char *folded)
 {
-	return (struct game_client *)hashtable_first(client_hashtable);
+	return name_link_client(skiplist_search_from(&client_list, folded));
 }
 
-static struct game_client *next_client()
+/*
+ * Returns the logged in client following client in the order of the
+ * usernames, or NULL.
+ */
+struct game_client *next_logged_client(struct game_client *client)
 {
-	return (struct game_client *)hashtable_next(client_hashtable);
+	return name_link_client(skiplist_next(&client->name_link));
 }
 
 /*
@@ -131,39 +210,71 @@ bool unique_username(const char *username)
 }
 
 /*
- * Returns the maximum socket file descriptor of the clients in the list.
+ * Returns the total number of logged in (with username) clients.
  */
-unsigned int get_max_fd()
+unsigned int logged_client_count()
 {
-	int maxfd;
-	struct game_client *client;
+	return SKIPLIST_COUNT(&client_list);
+}
+
+/*
+ * Returns the total number of connected clients.
+ */
+unsigned int connected_client_count()
+{
+	return connected_count;
+}
 
-	client = first_client();
-	for (maxfd = 0; client; client = next_client())
-		maxfd = (client->sock > maxfd) ? client->sock : maxfd;
+/*
+ * Returns the number of clients connected from the specified address.
+ */
+#if defined(USE_IPV6_ADDRESSING) && USE_IPV6_ADDRESSING == 1
+unsigned int address_client_count(struct in6_addr address)
+#else
+unsigned int address_client_count(struct in_addr address)
+#endif
+{
+	struct address_clients *ac;
 
-	return maxfd;
+	ac = hashtable_search(&address_hashtable, &address);
+	return ac ? ac->count : 0;
 }
 
 /*
- * Returns the total number of logged in (with username) clients.
+ * Prints how many clients are connected, from how many network addresses,
+ * and the address with the most of them.
  */
-unsigned int logged_client_count()
+void print_address_stats()
 {
-	return logged_count;
+	struct hashtable_iter it;
+	struct address_clients *ac;
+	unsigned int top = 0;
+	const void *key, *top_key = NULL;
+	char addrstr[ADDRESS_STRING_LENGTH];
+
+	hashtable_iter_init(&it, &address_hashtable);
+	while ((ac = hashtable_iter_next(&it, &key)))
+		if (ac->count > top) {
+			top = ac->count;
+			top_key = key;
+		}
+
+	printf("Clients: %u connected, %lu network addresses", connected_count,
+			(unsigned long)HASHTABLE_COUNT(&address_hashtable));
+	if (top_key && inet_ntop(ADDRESS_FAMILY, top_key, addrstr,
+				ADDRESS_STRING_LENGTH))
+		printf(" (at most %u clients from %s)", top, addrstr);
+	putchar('\n');
 }
 
 /*
- * Deletes all remaining allocated data in the list.
+ * Deletes all remaining allocated data in the list. The clients must have
+ * been removed.
  */
 void client_list_destroy()
 {
-	struct game_client *client;
-
-	for (client = first_client(); client; client = next_client())
-		remove_client(client);
+	hashtable_free(&address_hashtable);
 
-	free(client_list);
-	client_list = NULL;
-	logged_count = 0;
+	initialized = false;
+	connected_count = 0;
 }
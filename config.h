@@ -35,16 +35,56 @@
 /* default port used when not specified in command line */
 #define	DEFAULT_SERVER_PORT	6683
 
+/* number of server threads, each one with its own listening socket and
+ * connections; 0 to start one thread per online CPU */
+#define	REACTOR_THREADS		0
+
+/* AF_UNIX stream socket where the server also accepts the connections of
+ * clients running on the same host, relative to the working directory of the
+ * server (better not a world-writable one, like /tmp); "" to listen only on
+ * the TCP port */
+#define	UNIX_SOCKET_PATH	"battle_server.sock"
+
 /* maximum pending connections to the server */
-#define	LISTEN_BACKLOG		10
+#define	LISTEN_BACKLOG		4096
+
+/* seconds the kernel waits for the first request of a client before making
+ * the connection available to the server (TCP_DEFER_ACCEPT); 0 to accept the
+ * connections as soon as the handshake completes */
+#define	DEFER_ACCEPT_SECONDS	5
+
+/* maximum number of connected clients, in total and from the same network
+ * address (not counting the local clients, on UNIX_SOCKET_PATH); the
+ * connections over the caps are answered with ANS_BUSY and closed. 0 for no
+ * limit; the total is lowered to fit in the limit of open files (server) */
+#define	MAX_CLIENTS		65536
+#define	MAX_CLIENTS_PER_ADDRESS	256
+
+/* requests per second (REQ_LOGIN, REQ_WHO, REQ_MATCHES, REQ_PLAY) allowed to
+ * a client on average and in a burst; the requests over the limit are answered
+ * with ANS_BUSY (server) */
+#define	REQUEST_RATE		20
+#define	REQUEST_BURST		40
+
+/* threads serving the requests that take long (the list of players) off the
+ * server threads; 0 to serve them in the server threads (server) */
+#define	WORKER_THREADS		2
+
+/* players copied at a time, with the client list locked, by a rebuild of the
+ * lists of players and matches (server) */
+#define	LIST_SNAPSHOT_CHUNK	256
+
+/* maximum connections accepted by a server thread in a single iteration */
+#define	ACCEPT_BUDGET		256
 
 /* seconds to wait before retrying to re-bind the address (used by server) */
 #define	BIND_INUSE_RETRY_SECS	5
 
 
-/* number of entries in the hashtable used to maintain the list of connected
- * clients (server) */
+/* initial number of slots of a hashtable (a power of two) and percentage of
+ * slots used that makes it grow (server) */
 #define	HASHTABLE_SIZE		16
+#define	HASHTABLE_MAX_LOAD	85
 
 /* buffer sizes for various inputs (client) */
 #define COMMAND_BUFFER_SIZE	100
@@ -117,9 +157,66 @@
 #define	WHO_STATUS_LENGTH	37
 #define	WHO_STATUS_BUFFER_SIZE	WHO_STATUS_LENGTH+1
 
-/* precision used to check for timeouts, in seconds (client & server) */
+/* precision used to check for timeouts, in seconds (client) */
 #define	SELECT_TIMEOUT_SECONDS	3
 
+/* maximum number of ready descriptors returned by a single poller wait
+ * (server) */
+#define	POLLER_MAX_EVENTS	256
+
+/* 0 to drive the server sockets with epoll; 1 to use io_uring multishot
+ * accept and recv (Linux >= 6.0). If io_uring is not available at runtime the
+ * server falls back to epoll. */
+#define	USE_IO_URING		0
+
+/* io_uring submission queue entries and provided receive buffers (server).
+ * URING_BUFFER_COUNT must be a power of 2. */
+#define	URING_QUEUE_DEPTH	1024
+#define	URING_BUFFER_COUNT	512
+#define	URING_BUFFER_SIZE	4096
+
+/* minimum free space in the input buffer of a client before reading from its
+ * socket; each read fills all the free space available (server) */
+#define	INPUT_READ_SIZE		4096
+
+/* messages and bytes of a client dispatched in a single iteration; the rest
+ * is dispatched at the next iterations, in turn with the other clients with
+ * input left over (server) */
+#define	DISPATCH_MESSAGE_BUDGET	32
+#define	DISPATCH_BYTE_BUDGET	8192
+
+/* microseconds a server thread spends at most in an iteration on the low
+ * priority work (console output, statistics) left after serving the
+ * clients (server) */
+#define	DEFERRED_WORK_BUDGET	1000
+
+/* maximum number of received bytes kept for a client while waiting for the
+ * rest of a message (server) */
+#define	MAX_INPUT_BUFFER_SIZE	4096
+
+/* bytes queued for a client above which the server stops reading its
+ * requests, until the queue drains below the low-water mark (server) */
+#define	OUTPUT_HIGH_WATER_MARK	65536
+#define	OUTPUT_LOW_WATER_MARK	16384
+
+/* bytes queued for a client above which it is disconnected, higher than
+ * OUTPUT_HIGH_WATER_MARK; the lists of players and matches are not counted,
+ * only the output queued before them, so a list of any size reaches a client
+ * reading its answers (server) */
+#define	OUTPUT_QUEUE_LIMIT	1048576
+
+/* objects allocated at once by the pools of clients, matches and mail;
+ * clients and matches with room allocated at startup (server) */
+#define	POOL_SLAB_OBJECTS	256
+#define	PREFAULT_CLIENTS	1024
+#define	PREFAULT_MATCHES	512
+
+/* size of a cache line: the pools start the objects on a line boundary */
+#define	CACHE_LINE_SIZE		64
+
+/* mail bigger than this is not allocated from the pool (server) */
+#define	MAIL_POOL_DATA_SIZE	64
+
 /* timeouts in seconds */
 #define	PLAY_REQUEST_TIMEOUT	60
 #define	IN_GAME_TIMEOUT		60
@@ -0,0 +1,104 @@
+/*
+ * This file is part of reti2016.
+ *
+ * reti2016 is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * reti2016 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * See file LICENSE for more details.
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include "console.h"
+#include "fdtable.h"
+
+/*
+ * Inserts obj at the descriptor fd, growing the array if necessary.
+ */
+void fdtable_insert(struct fdtable *t, int fd, void *obj)
+{
+	void **slots;
+	size_t size;
+
+	if ((size_t)fd >= t->size) {
+		size = t->size ? t->size : 64;
+		while (size <= (size_t)fd)
+			size *= 2;
+		errno = 0;
+		slots = realloc(t->slots, size * sizeof(void *));
+		if (!slots) {
+			print_error("realloc", errno);
+			exit(EXIT_FAILURE);
+		}
+		memset(slots + t->size, 0, (size - t->size) * sizeof(void *));
+		t->slots = slots;
+		t->size = size;
+	}
+
+	if (!t->slots[fd])
+		t->count++;
+	t->slots[fd] = obj;
+	if (fd > t->max_fd)
+		t->max_fd = fd;
+}
+
+/*
+ * Removes and returns the object at the descriptor fd, or NULL if there is
+ * none.
+ */
+void *fdtable_remove(struct fdtable *t, int fd)
+{
+	void *obj;
+
+	if (fd < 0 || fd > t->max_fd || !(obj = t->slots[fd]))
+		return NULL;
+
+	t->slots[fd] = NULL;
+	/* the descriptors are shared by the tables of all the reactors, so a
+	 * table is sparse: max_fd is left as a bound rather than searched for
+	 * below, until the table is empty */
+	if (--t->count == 0)
+		t->max_fd = -1;
+	return obj;
+}
+
+void *fdtable_search(struct fdtable *t, int fd)
+{
+	if (fd < 0 || fd > t->max_fd)
+		return NULL;
+	return t->slots[fd];
+}
+
+/*
+ * Returns the object at the lowest descriptor above *fd and stores the
+ * descriptor in *fd, or NULL if there is none. Starting from *fd = -1, it
+ * iterates over all the objects; the position is kept by the caller, so
+ * objects can be removed during the iteration.
+ */
+void *fdtable_next(struct fdtable *t, int *fd)
+{
+	int i;
+
+	for (i = *fd + 1; i <= t->max_fd; i++)
+		if (t->slots[i]) {
+			*fd = i;
+			return t->slots[i];
+		}
+	*fd = t->max_fd;
+	return NULL;
+}
+
+void fdtable_free(struct fdtable *t)
+{
+	if (t->slots)
+		free(t->slots);
+	FDTABLE_INIT(t);
+}
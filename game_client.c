@@ -14,25 +14,105 @@
  * See file LICENSE for more details.
  */
 
+#include <ctype.h>
 #include <errno.h>
-#include <assert.h>
+#include <pthread.h>
 #include <stdlib.h>
 #include <string.h>
-#include <time.h>
 #include "console.h"
 #include "game_client.h"
+#include "pool.h"
+
+/*
+ * Clients and matches are allocated from pools, which are not thread safe,
+ * and so is the registry of the matches: the server creates and deletes them
+ * with the client list locked.
+ */
+static struct pool client_pool = POOL_INITIALIZER("clients",
+		sizeof(struct game_client), POOL_SLAB_OBJECTS);
+static struct pool match_pool = POOL_INITIALIZER("matches",
+		sizeof(struct match), POOL_SLAB_OBJECTS);
+
+/*
+ * Registry of the matches: a dense array, walked in time proportional to the
+ * number of matches. Every match keeps its slot in the array, so that it is
+ * removed in O(1) by moving the last match in its place.
+ */
+static struct match **matches;
+static size_t matches_used;
+static size_t matches_size;
+static uint32_t last_match_id;
+
+/*
+ * Version of the list of players, bumped by the changes that show in it:
+ * logins, logouts and matches.
+ */
+static unsigned long version;
+
+/*
+ * Makes room in the pools for the specified number of clients and matches,
+ * so that they are allocated without system calls or page faults. Returns
+ * false on error.
+ */
+bool prefault_game_pools(size_t clients, size_t matches)
+{
+	return pool_prefault(&client_pool, clients) &&
+		pool_prefault(&match_pool, matches);
+}
+
+void print_game_pool_stats()
+{
+	pool_print_stats(&client_pool);
+	pool_print_stats(&match_pool);
+}
+
+void destroy_game_pools()
+{
+	pool_destroy(&client_pool);
+	pool_destroy(&match_pool);
+	free(matches);
+	matches = NULL;
+	matches_used = matches_size = 0;
+}
+
+/* Makes room in the registry for one more match */
+static void grow_matches()
+{
+	struct match **m;
+	size_t size;
+
+	if (matches_used < matches_size)
+		return;
+
+	size = matches_size ? matches_size * 2 : POOL_SLAB_OBJECTS;
+	errno = 0;
+	m = realloc(matches, size * sizeof(*matches));
+	if (!m) {
+		print_error("realloc", errno);
+		exit(EXIT_FAILURE);
+	}
+	matches = m;
+	matches_size = size;
+}
 
 struct match *add_match(struct game_client *p1, struct game_client *p2)
 {
 	struct match *m;
 
-	m = malloc(sizeof(struct match));
+	grow_matches();
+	m = pool_alloc(&match_pool);
+	if (!m)
+		exit(EXIT_FAILURE);
 	m->player1 = p1;
 	m->player2 = p2;
 	p1->match = m;
 	p2->match = m;
 	m->awaiting_reply = true;
-	m->request_time = time(NULL);
+	TIMER_INIT(&m->timeout);
+	m->id = ++last_match_id;
+	m->slot = matches_used;
+	matches[matches_used++] = m;
+	players_changed();
 	return m;
 }
 
@@ -41,10 +121,40 @@ void delete_match(struct match *m)
 	if (!m)
 		return;
 
+	timer_cancel(&m->timeout);
 	m->player1->match = NULL;
 	m->player2->match = NULL;
 
-	free(m);
+	matches[m->slot] = matches[--matches_used];
+	matches[m->slot]->slot = m->slot;
+	players_changed();
+
+	pool_free(&match_pool, m);
+}
+
+void players_changed()
+{
+	version++;
+}
+
+unsigned long players_version()
+{
+	return version;
+}
+
+size_t match_count()
+{
+	return matches_used;
+}
+
+/*
+ * Returns the match in the slot i of the registry, with i less than
+ * match_count(). Deleting the match in the slot i moves the last match in
+ * that slot: a walk that deletes matches goes from the last slot down.
+ */
+struct match *get_match(size_t i)
+{
+	return matches[i];
 }
 
 /*
@@ -60,12 +170,9 @@ struct game_client *create_client(const char *username, in_port_t in_port,
 {
 	struct game_client *client;
 
-	errno = 0;
-	client = malloc(sizeof(struct game_client));
-	if (!client) {
-		print_error("malloc", errno);
+	client = pool_alloc(&client_pool);
+	if (!client)
 		exit(EXIT_FAILURE);
-	}
 
 	if (username) {
 		strncpy(client->username, username, MAX_USERNAME_SIZE);
@@ -73,10 +180,27 @@ struct game_client *create_client(const char *username, in_port_t in_port,
 	} else {
 		*client->username = '\0';
 	}
+	*client->folded_name = '\0';
+	client->name_link.key = NULL;
+	client->who_slot = WHO_SLOT_NONE;
 	client->port = in_port;
 	client->address = in_addr;
 	client->match = NULL;
 	client->sock = sock;
+	BUFFER_INIT(&client->inbuf);
+	BUFFER_INIT(&client->outbuf);
+	BUFFER_INIT(&client->bulkbuf);
+	client->bulk_left = 0;
+	client->owner = NULL;
+	client->poll_events = 0;
+	client->throttled = false;
+	client->stalled = false;
+	client->pending = false;
+	client->busy = false;
+	client->write_failed = false;
+	client->dirty = false;
+	client->tokens = REQUEST_BURST;
+	client->tokens_time = timer_clock();
 
 	return client;
 }
@@ -89,25 +213,52 @@ void delete_client(struct game_client *client)
 	if (client->match)
 		delete_match(client->match);
 
-	free(client);
+	pool_free(&client_pool, client);
 }
 
-bool valid_username(const char *username)
+/*
+ * Lower case form of the characters allowed in the usernames, indexed by
+ * character; 0 for the characters not allowed. It is filled once, by the
+ * first thread folding a username.
+ */
+static char username_chars[256];
+static pthread_once_t username_chars_once = PTHREAD_ONCE_INIT;
+
+static void init_username_chars()
 {
-	size_t i, len;
+	const char *p;
 
-	len = strlen(username);
-	if (len < MIN_USERNAME_LENGTH || len > MAX_USERNAME_LENGTH)
-		return false;
+	for (p = USERNAME_ALLOWED_CHARS; *p; p++)
+		username_chars[(unsigned char)*p] = tolower((unsigned char)*p);
+}
+
+/*
+ * Validates a username and writes its lower case form in folded, which must
+ * hold MAX_USERNAME_SIZE characters: usernames differing only in case have
+ * the same folded form. Returns the length of the username, or 0 if it is
+ * not valid. It is safe to call from any thread.
+ */
+size_t fold_username(char *folded, const char *username)
+{
+	size_t len;
+
+	pthread_once(&username_chars_once, init_username_chars);
 
-	assert(username[len] == '\0');
+	for (len = 0; len <= MAX_USERNAME_LENGTH && username[len]; len++)
+		if (!(folded[len] = username_chars[(unsigned char)username[len]]))
+			return 0;
+	if (len < MIN_USERNAME_LENGTH || len > MAX_USERNAME_LENGTH)
+		return 0;
 
-	for (i = 0; i < len && username[i] != '\0'; i++)
-		if (!strchr(USERNAME_ALLOWED_CHARS, username[i]))
-			return false;
+	folded[len] = '\0';
+	return len;
+}
 
-	return true;
+bool valid_username(const char *username)
+{
+	char folded[MAX_USERNAME_SIZE];
 
+	return fold_username(folded, username) != 0;
 }
 
 bool logged_in(struct game_client *client)
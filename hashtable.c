@@ -14,57 +14,198 @@
  * See file LICENSE for more details.
  */
 
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "console.h"
 #include "hashtable.h"
 
-static int cur_index;
+/*
+ * Slot of the table. dist is the distance of the slot from the one the key
+ * hashes to, plus one: zero marks an empty slot. The full hash of the key is
+ * kept to compare the keys only when it matches.
+ */
+struct hashtable_entry {
+	uint32_t hash;
+	unsigned int dist;
+	const void *key;
+	void *obj;
+};
 
-static int compute_hash(int key)
+/*
+ * Hashes the key_size bytes of a key (FNV-1a), then mixes the bits of the
+ * result (finalizer of MurmurHash3), so that keys differing only in a few
+ * bits do not collide.
+ */
+static uint32_t compute_hash(const void *key, size_t key_size)
 {
-	return (key % HASHTABLE_SIZE);
+	const unsigned char *p = key;
+	uint32_t h = 2166136261u;
+	size_t i;
+
+	for (i = 0; i < key_size; i++)
+		h = (h ^ p[i]) * 16777619u;
+
+	h ^= h >> 16;
+	h *= 0x85ebca6b;
+	h ^= h >> 13;
+	h *= 0xc2b2ae35;
+	h ^= h >> 16;
+	return h;
 }
 
-int hashtable_insert(struct list_head ht[], void *obj, int *key)
+/*
+ * Stores an entry, swapping it with the entries nearer to their home slot
+ * found on the way (Robin Hood): the probe sequences stay short.
+ */
+static void put_entry(struct hashtable *ht, struct hashtable_entry e)
 {
-	int h;
-	h = compute_hash(*key);
-	list_insert(&ht[h], obj, (void *)key);
-	return h;
+	struct hashtable_entry tmp;
+	size_t i;
+
+	e.dist = 1;
+	for (i = e.hash & (ht->size - 1);; i = (i + 1) & (ht->size - 1)) {
+		if (!ht->entries[i].dist) {
+			ht->entries[i] = e;
+			return;
+		}
+		if (ht->entries[i].dist < e.dist) {
+			tmp = ht->entries[i];
+			ht->entries[i] = e;
+			e = tmp;
+		}
+		e.dist++;
+	}
+}
+
+static void resize(struct hashtable *ht, size_t size)
+{
+	struct hashtable_entry *old = ht->entries;
+	size_t i, old_size = ht->size;
+
+	errno = 0;
+	ht->entries = calloc(size, sizeof(struct hashtable_entry));
+	if (!ht->entries) {
+		print_error("calloc", errno);
+		exit(EXIT_FAILURE);
+	}
+	ht->size = size;
+
+	for (i = 0; i < old_size; i++)
+		if (old[i].dist)
+			put_entry(ht, old[i]);
+	if (old)
+		free(old);
 }
 
-void *hashtable_remove(struct list_head ht[], int key)
+/*
+ * Returns the index of the slot holding key, or ht->size if there is none.
+ */
+static size_t find_slot(struct hashtable *ht, const void *key)
 {
-	return list_remove(&ht[compute_hash(key)], (void *)&key);
+	unsigned int dist;
+	uint32_t hash;
+	size_t i;
+
+	if (!ht->count)
+		return ht->size;
+
+	hash = compute_hash(key, ht->key_size);
+	i = hash & (ht->size - 1);
+	for (dist = 1; ht->entries[i].dist >= dist; dist++) {
+		if (ht->entries[i].hash == hash &&
+				!memcmp(ht->entries[i].key, key, ht->key_size))
+			return i;
+		i = (i + 1) & (ht->size - 1);
+	}
+	return ht->size;
 }
 
-void *hashtable_search(struct list_head ht[], int key)
+/*
+ * Inserts obj with the specified key, which must not be in the hashtable.
+ */
+void hashtable_insert(struct hashtable *ht, const void *key, void *obj)
 {
-	return list_search(&ht[compute_hash(key)], (void *)&key);
+	struct hashtable_entry e;
+
+	if (!ht->size)
+		resize(ht, HASHTABLE_SIZE);
+	else if ((ht->count + 1) * 100 > ht->size * HASHTABLE_MAX_LOAD)
+		resize(ht, ht->size * 2);
+
+	e.hash = compute_hash(key, ht->key_size);
+	e.key = key;
+	e.obj = obj;
+	put_entry(ht, e);
+	ht->count++;
 }
 
-static void *get_next(struct list_head ht[], void *n)
+/*
+ * Removes the object with the specified key and returns it, or NULL if there
+ * is none. The following entries are shifted back, so no tombstone is left.
+ */
+void *hashtable_remove(struct hashtable *ht, const void *key)
 {
-	while (!n) {
-		cur_index++;
-		if (cur_index == HASHTABLE_SIZE)
-			return NULL;
-		n = list_first(&ht[cur_index]);
+	size_t i, next;
+	void *obj;
+
+	if ((i = find_slot(ht, key)) == ht->size)
+		return NULL;
+	obj = ht->entries[i].obj;
+
+	for (next = (i + 1) & (ht->size - 1); ht->entries[next].dist > 1;
+			next = (next + 1) & (ht->size - 1)) {
+		ht->entries[i] = ht->entries[next];
+		ht->entries[i].dist--;
+		i = next;
 	}
-	return n;
+	ht->entries[i].dist = 0;
+	ht->count--;
+	return obj;
 }
 
-void *hashtable_first(struct list_head ht[])
+void *hashtable_search(struct hashtable *ht, const void *key)
 {
-	void *n;
+	size_t i;
 
-	cur_index = 0;
-	n = list_first(&ht[cur_index]);
-	return get_next(ht, n);
+	if ((i = find_slot(ht, key)) == ht->size)
+		return NULL;
+	return ht->entries[i].obj;
 }
 
-void *hashtable_next(struct list_head ht[])
+void hashtable_iter_init(struct hashtable_iter *it, struct hashtable *ht)
 {
-	void *n;
+	it->ht = ht;
+	it->index = 0;
+}
 
-	n = list_next(&ht[cur_index]);
-	return get_next(ht, n);
+/*
+ * Returns the next object of the iteration and stores its key in *key (if
+ * not NULL), or returns NULL at the end.
+ */
+void *hashtable_iter_next(struct hashtable_iter *it, const void **key)
+{
+	struct hashtable_entry *e;
+
+	for (; it->index < it->ht->size; it->index++) {
+		e = &it->ht->entries[it->index];
+		if (e->dist) {
+			it->index++;
+			if (key)
+				*key = e->key;
+			return e->obj;
+		}
+	}
+	return NULL;
+}
+
+/*
+ * Frees the slots (but not the objects).
+ */
+void hashtable_free(struct hashtable *ht)
+{
+	if (ht->entries)
+		free(ht->entries);
+	HASHTABLE_INIT(ht, ht->key_size);
 }
@@ -0,0 +1,50 @@
+/*
+ * This file is part of reti2016.
+ *
+ * reti2016 is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * reti2016 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * See file LICENSE for more details.
+ */
+
+#ifndef	_BATTLE_BUFFER_H
+#define	_BATTLE_BUFFER_H
+
+#include <stddef.h>
+
+#define	BUFFER_INIT(_buf)	do {\
+		(_buf)->data = NULL;\
+		(_buf)->size = 0;\
+		(_buf)->start = 0;\
+		(_buf)->end = 0;\
+	} while(0)
+
+/* number of bytes stored and pointer to the first of them */
+#define	BUFFER_LENGTH(_buf)	((_buf)->end - (_buf)->start)
+#define	BUFFER_DATA(_buf)	((_buf)->data + (_buf)->start)
+
+/*
+ * Contiguous byte buffer: bytes are appended at end and consumed from start.
+ * The free space at the beginning is reclaimed only when more room is needed.
+ */
+struct buffer {
+	char *data;
+	size_t size;
+	size_t start;
+	size_t end;
+};
+
+void buffer_free(struct buffer *buf);
+char *buffer_reserve(struct buffer *buf, size_t len);
+void buffer_commit(struct buffer *buf, size_t len);
+bool buffer_append(struct buffer *buf, const void *src, size_t len);
+void buffer_consume(struct buffer *buf, size_t len);
+
+#endif
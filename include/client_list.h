@@ -22,24 +22,37 @@
 void client_list_init();
 void client_list_destroy();
 
+/* the list is shared by all the server threads: the functions below must be
+ * called with the list locked */
+void client_list_lock();
+void client_list_unlock();
+
 #if defined(USE_IPV6_ADDRESSING) && USE_IPV6_ADDRESSING == 1
-void add_client(struct in6_addr address, int sockfd);
+struct game_client *add_client(struct in6_addr address, bool local,
+		int sockfd, struct reactor *owner);
 #else
-void add_client(struct in_addr address, int sockfd);
+struct game_client *add_client(struct in_addr address, bool local,
+		int sockfd, struct reactor *owner);
 #endif
 void login_client(struct game_client *client, const char *username,
 		in_port_t port);
 void remove_client(struct game_client *client);
 
-struct game_client *get_client_by_socket(int fd);
 struct game_client *get_client_by_username(const char *username);
 
 struct game_client *first_logged_client();
-struct game_client *next_logged_client();
+struct game_client *first_logged_client_from(const char *folded);
+struct game_client *next_logged_client(struct game_client *client);
 
 bool unique_username(const char *username);
 
-unsigned int get_max_fd();
 unsigned int logged_client_count();
+unsigned int connected_client_count();
+void print_address_stats();
+#if defined(USE_IPV6_ADDRESSING) && USE_IPV6_ADDRESSING == 1
+unsigned int address_client_count(struct in6_addr address);
+#else
+unsigned int address_client_count(struct in_addr address);
+#endif
 
 #endif
@@ -0,0 +1,50 @@
+/*
+ * This file is part of reti2016.
+ *
+ * reti2016 is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * reti2016 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * See file LICENSE for more details.
+ */
+
+#ifndef	_BATTLE_FDTABLE_H
+#define	_BATTLE_FDTABLE_H
+
+#include <stddef.h>
+
+#define	FDTABLE_INIT(_t)	do {\
+		(_t)->slots = NULL;\
+		(_t)->size = 0;\
+		(_t)->count = 0;\
+		(_t)->max_fd = -1;\
+	} while(0)
+
+/* bound of the descriptors in the table: the highest inserted since it was
+ * last empty, or -1 if it is empty */
+#define	FDTABLE_MAX_FD(_t)	((_t)->max_fd)
+
+/*
+ * Table of objects indexed by file descriptor. The array grows on demand up
+ * to the highest descriptor inserted.
+ */
+struct fdtable {
+	void **slots;
+	size_t size;
+	size_t count;
+	int max_fd;
+};
+
+void fdtable_insert(struct fdtable *t, int fd, void *obj);
+void *fdtable_remove(struct fdtable *t, int fd);
+void *fdtable_search(struct fdtable *t, int fd);
+void *fdtable_next(struct fdtable *t, int *fd);
+void fdtable_free(struct fdtable *t);
+
+#endif
@@ -17,31 +17,94 @@
 #ifndef	_BATTLE_GAME_CLIENT_H
 #define	_BATTLE_GAME_CLIENT_H
 
+#include <limits.h>
+#include <stdint.h>
 #include <netinet/in.h>
+#include "buffer.h"
+#include "skiplist.h"
+#include "timer.h"
 
 struct match;
+struct reactor;
 
+/* who_slot of a client not in the list of players (server) */
+#define	WHO_SLOT_NONE	UINT_MAX
+
+/* number of bytes queued for a client (server) */
+#define	CLIENT_OUTPUT_LENGTH(_c)	(BUFFER_LENGTH(&(_c)->outbuf) + \
+		BUFFER_LENGTH(&(_c)->bulkbuf))
+
+/*
+ * The fields are grouped by access pattern. The first cache line holds what
+ * a step of a search by username reads: the folded username, the key of the
+ * skiplist link pointing to it and the lowest three levels of the tower,
+ * where nearly all the steps happen. The sweep over the logged in clients
+ * (list of players) reads the lowest level there too, then the username, the
+ * match and who_slot, which follow the tower. The connection state used
+ * by the owner thread comes next, and the identity data read only at login
+ * and by the play requests comes last. The pools start every client on a
+ * cache line boundary.
+ */
 struct game_client {
+	/* hot: lookups */
+	char folded_name[MAX_USERNAME_SIZE]; /* lower case username (server) */
+	struct skiplist_link name_link; /* in the logged in clients (server) */
+
+	/* warm: sweeps */
 	char username[MAX_USERNAME_SIZE];
+	struct match *match;
+	int sock;
+	/* index in the shared list of players, or WHO_SLOT_NONE (server) */
+	unsigned int who_slot;
+
+	/* connection state, used by the owner thread (server) */
+	struct reactor *owner; /* thread serving the connection */
+	unsigned int poll_events; /* events watched by the owner */
+	bool throttled; /* requests not read while output is queued */
+	bool stalled; /* requests left in inbuf while output is queued */
+	bool pending; /* requests left in inbuf by the dispatch budget */
+	bool busy; /* a request is being served by a worker */
+	/* sends the answer to the request served by a worker */
+	void (*answer)(struct game_client *client);
+	bool write_failed; /* output discarded, closing */
+	bool dirty; /* output queued since the last flush */
+	struct buffer inbuf; /* received bytes not yet processed */
+	struct buffer outbuf; /* control messages waiting to be sent */
+	struct buffer bulkbuf; /* bulk messages, sent after outbuf */
+	size_t bulk_left; /* bytes left of a partially sent bulk message */
+	double tokens; /* request rate limiter bucket */
+	uint64_t tokens_time; /* last refill of the bucket, in ms */
+
+	/* cold: identity */
 	in_port_t port;
+	bool local; /* connected on the AF_UNIX socket (server) */
 #if defined(USE_IPV6_ADDRESSING) && USE_IPV6_ADDRESSING == 1
 	struct in6_addr address;
 #else
 	struct in_addr address;
 #endif
-	struct match *match;
-	int sock;
-};
+} __attribute__((aligned(CACHE_LINE_SIZE)));
 
 struct match {
 	struct game_client *player1;
 	struct game_client *player2;
 	bool awaiting_reply;
-	time_t request_time;
+	struct timer timeout; /* of the play request (server) */
+	uint32_t id; /* unique among the current matches */
+	size_t slot; /* position in the registry */
 };
 
+bool prefault_game_pools(size_t clients, size_t matches);
+void print_game_pool_stats();
+void destroy_game_pools();
+
 struct match *add_match(struct game_client *p1, struct game_client *p2);
 void delete_match(struct match *match);
+size_t match_count();
+struct match *get_match(size_t i);
+
+void players_changed();
+unsigned long players_version();
 
 #if defined(USE_IPV6_ADDRESSING) && USE_IPV6_ADDRESSING == 1
 struct game_client *create_client(const char *username, in_port_t in_port,
@@ -52,6 +115,7 @@ struct game_client *create_client(const char *username, in_port_t in_port,
 #endif
 void delete_client(struct game_client *client);
 
+size_t fold_username(char *folded, const char *username);
 bool valid_username(const char *username);
 bool logged_in(struct game_client *client);
 
@@ -17,21 +17,49 @@
 #ifndef	_BATTLE_HASHTABLE_H
 #define	_BATTLE_HASHTABLE_H
 
-#include "list.h"
+#include <stddef.h>
 
-#define HASHTABLE_INIT(_ht)	do {\
-		int __for_counter;\
-		for (__for_counter = 0; __for_counter < HASHTABLE_SIZE;\
-				__for_counter++)\
-			LIST_INIT(&(_ht)[__for_counter], TP_INT);\
-		} while(0)
+#define	HASHTABLE_INIT(_ht, _key_size)	do {\
+		(_ht)->entries = NULL;\
+		(_ht)->size = 0;\
+		(_ht)->count = 0;\
+		(_ht)->key_size = (_key_size);\
+	} while(0)
 
-int hashtable_insert(struct list_head ht[], void *obj, int *key);
-void *hashtable_remove(struct list_head ht[], int key);
-void *hashtable_search(struct list_head ht[], int key);
+/* number of objects in the hashtable */
+#define	HASHTABLE_COUNT(_ht)	((_ht)->count)
 
-void *hashtable_first(struct list_head ht[]);
-void *hashtable_next(struct list_head ht[]);
+struct hashtable_entry;
 
+/*
+ * Open addressing hashtable of objects with a key of key_size bytes, with
+ * Robin Hood linear probing. The keys are not copied: each one must stay
+ * valid (usually as a field of its object) while the object is in the
+ * hashtable. It doubles its size when the load factor reaches
+ * HASHTABLE_MAX_LOAD.
+ */
+struct hashtable {
+	struct hashtable_entry *entries;
+	size_t size;
+	size_t count;
+	size_t key_size;
+};
+
+/*
+ * Position of an iteration over a hashtable. The hashtable must not be
+ * modified during the iteration.
+ */
+struct hashtable_iter {
+	struct hashtable *ht;
+	size_t index;
+};
+
+void hashtable_insert(struct hashtable *ht, const void *key, void *obj);
+void *hashtable_remove(struct hashtable *ht, const void *key);
+void *hashtable_search(struct hashtable *ht, const void *key);
+void hashtable_free(struct hashtable *ht);
+
+void hashtable_iter_init(struct hashtable_iter *it, struct hashtable *ht);
+void *hashtable_iter_next(struct hashtable_iter *it, const void **key);
 
 #endif
@@ -0,0 +1,61 @@
+/*
+ * This file is part of reti2016.
+ *
+ * reti2016 is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * reti2016 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * See file LICENSE for more details.
+ */
+
+#ifndef	_BATTLE_MAILBOX_H
+#define	_BATTLE_MAILBOX_H
+
+#include <stddef.h>
+#include <pthread.h>
+#include <sys/uio.h>
+#include "pool.h"
+
+/* bytes to be delivered to target by the thread owning the mailbox */
+struct mail {
+	void *target;
+	struct mail *next;
+	size_t len;
+	char data[];
+};
+
+/*
+ * Queue of mail posted by other threads. The owner watches the eventfd,
+ * which becomes readable when the queue stops being empty or the owner is
+ * woken up explicitly. Small mail is allocated from the pool, protected by
+ * the lock too.
+ */
+struct mailbox {
+	pthread_mutex_t lock;
+	struct mail *head;
+	struct mail *tail;
+	struct pool pool;
+	int efd;
+};
+
+#define	MAILBOX_FD(_mb)		((_mb)->efd)
+
+bool mailbox_init(struct mailbox *mb);
+void mailbox_destroy(struct mailbox *mb);
+bool mailbox_post(struct mailbox *mb, void *target, const void *data,
+		size_t len);
+bool mailbox_postv(struct mailbox *mb, void *target, const struct iovec *iov,
+		int iovcnt);
+struct mail *mailbox_take(struct mailbox *mb);
+void mailbox_release(struct mailbox *mb, struct mail *m);
+void mailbox_forget(struct mailbox *mb, void *target);
+void mailbox_wake(struct mailbox *mb);
+void mailbox_print_stats(struct mailbox *mb);
+
+#endif
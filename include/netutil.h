@@ -20,7 +20,8 @@
 #include <stddef.h>
 #include <netinet/in.h>
 
-int listen_on_port(in_port_t port);
+int listen_on_port(in_port_t port, bool reuse_port, int defer_secs);
+int listen_on_unix_socket(const char *path);
 int accept_socket_connection(int sockfd, struct sockaddr_storage *sa);
 int open_local_port(in_port_t port);
 int bytes_available(int fd);
@@ -40,5 +41,6 @@ void fill_sockaddr(struct sockaddr_storage *ss,
 		struct in_addr address, in_port_t port);
 int connect_to_server(struct in_addr addr, in_port_t port);
 #endif
+int connect_to_unix_socket(const char *path);
 
 #endif
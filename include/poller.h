@@ -0,0 +1,54 @@
+/*
+ * This file is part of reti2016.
+ *
+ * reti2016 is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * reti2016 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * See file LICENSE for more details.
+ */
+
+#ifndef	_BATTLE_POLLER_H
+#define	_BATTLE_POLLER_H
+
+/* events that can be watched for and reported by the poller */
+#define	POLLER_IN	0x01
+#define	POLLER_OUT	0x02
+#define	POLLER_HUP	0x04
+/* listening socket: with io_uring result holds the accepted socket (or
+ * -errno) */
+#define	POLLER_ACCEPT	0x08
+/* connected socket: with io_uring data points to result received bytes
+ * (0 on end of file, -errno on error) */
+#define	POLLER_RECV	0x10
+/* listening socket watched by several pollers: with epoll a connection wakes
+ * up only one of them (io_uring accept requests already behave this way).
+ * Only valid for poller_add() */
+#define	POLLER_EXCLUSIVE	0x20
+
+struct poller;
+
+struct poller_event {
+	int fd;
+	unsigned int events;
+	int result;
+	char *data;
+};
+
+struct poller *poller_create();
+void poller_destroy(struct poller *poller);
+
+bool poller_add(struct poller *poller, int fd, unsigned int events);
+bool poller_modify(struct poller *poller, int fd, unsigned int events);
+bool poller_remove(struct poller *poller, int fd);
+
+int poller_wait(struct poller *poller, struct poller_event *events,
+		int maxevents, int timeout);
+
+#endif
@@ -0,0 +1,52 @@
+/*
+ * This file is part of reti2016.
+ *
+ * reti2016 is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * reti2016 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * See file LICENSE for more details.
+ */
+
+#ifndef	_BATTLE_POOL_H
+#define	_BATTLE_POOL_H
+
+#include <stddef.h>
+
+#define	POOL_INITIALIZER(_name, _size, _per_slab)\
+		{_name, _size, _per_slab, NULL, NULL, 0, 0, 0}
+
+struct pool_slab;
+
+/*
+ * Allocator of objects of the same size. Objects are carved out of slabs of
+ * per_slab objects and recycled through a free list; slabs are released
+ * only when the pool is destroyed. A pool is not thread safe: the callers
+ * must serialize the accesses.
+ */
+struct pool {
+	const char *name;
+	size_t obj_size;
+	size_t per_slab;
+	void *free_list;
+	struct pool_slab *slabs;
+	size_t slab_count;
+	size_t in_use;
+	size_t peak;
+};
+
+void pool_init(struct pool *p, const char *name, size_t obj_size,
+		size_t per_slab);
+void pool_destroy(struct pool *p);
+bool pool_prefault(struct pool *p, size_t count);
+void *pool_alloc(struct pool *p);
+void pool_free(struct pool *p, void *obj);
+void pool_print_stats(struct pool *p);
+
+#endif
@@ -31,13 +31,17 @@ enum __attribute__ ((packed)) msg_type {
 	MSG_SHOT	= 0x88,
 	MSG_RESULT	= 0x89,
 	MSG_ENDGAME	= 0xAA,
+	ANS_BUSY	= 0xFB,
+	REQ_MATCHES	= 0x0C,
+	ANS_MATCHES	= 0xFD,
 	ANS_BADREQ	= 0xFF
 };
 
 enum __attribute__ ((packed)) login_response {
 	LOGIN_OK,
 	LOGIN_INVALID_NAME,
-	LOGIN_NAME_INUSE
+	LOGIN_NAME_INUSE,
+	LOGIN_ALREADY_LOGGED_IN /* the connection has a username already */
 };
 
 enum __attribute__ ((packed)) player_status {
@@ -51,7 +55,8 @@ enum __attribute__ ((packed)) play_response {
 	PLAY_ACCEPT,
 	PLAY_INVALID_OPPONENT,
 	PLAY_OPPONENT_IN_GAME,
-	PLAY_TIMEDOUT
+	PLAY_TIMEDOUT,
+	PLAY_ALREADY_IN_GAME /* the requester has a match already */
 };
 
 /* element of the flexible array used in ANS_WHO */
@@ -61,6 +66,14 @@ struct __attribute__ ((packed)) who_player {
 	char opponent[MAX_USERNAME_SIZE];
 };
 
+/* element of the flexible array used in ANS_MATCHES */
+struct __attribute__ ((packed)) match_entry {
+	uint32_t id;
+	char player1[MAX_USERNAME_SIZE]; /* sender of the play request */
+	char player2[MAX_USERNAME_SIZE];
+	enum player_status status; /* PLAYER_AWAITING_REPLY or PLAYER_IN_GAME */
+};
+
 /* common header */
 struct __attribute__ ((packed)) msg_header {
 	char magic[2];
@@ -149,6 +162,23 @@ struct __attribute__ ((packed)) msg_endgame {
 	bool disconnected;
 };
 
+/* the server is overloaded and has not processed the request (or has refused
+ * the connection): the client can try again later */
+struct __attribute__ ((packed)) ans_busy {
+	struct msg_header header;
+};
+
+/* list of matches request (!matches) */
+struct __attribute__ ((packed)) req_matches {
+	struct msg_header header;
+};
+
+/* list of matches response */
+struct __attribute__ ((packed)) ans_matches {
+	struct msg_header header;
+	struct match_entry matches[];
+};
+
 /* bad request to the server (client terminates on reception) */
 struct __attribute__ ((packed)) ans_badreq {
 	struct msg_header header;
@@ -162,11 +192,14 @@ struct message *read_message_async(int sockfd, bool *noblock);
 struct message *read_udp_message(int sockfd);
 struct message *read_udp_message_async(int sockfd, bool *noblock);
 struct message *read_message_type(int sockfd, enum msg_type type);
+bool parse_message(int sockfd, char *buf, size_t len, struct message **msg);
 
 bool send_req_login(int sockfd, const char *username, in_port_t port);
 bool send_ans_login(int sockfd, enum login_response response);
 bool send_req_who(int sockfd);
 bool send_ans_who(int sockfd, struct who_player players[], int count);
+bool send_ans_who_shared(int sockfd, const struct who_player players[],
+		int count, int skip); /* server */
 bool send_req_play(int sockfd, const char *opponent);
 bool send_req_play_ans(int sockfd, bool accept);
 #if defined(USE_IPV6_ADDRESSING) && USE_IPV6_ADDRESSING == 1
@@ -177,6 +210,11 @@ bool send_ans_play(int sockfd, enum play_response response,
 		struct in_addr addr, in_port_t port);
 #endif
 bool send_msg_endgame(int sockfd, bool disconnected);
+bool send_ans_busy(int sockfd);
+bool send_req_matches(int sockfd);
+bool send_ans_matches(int sockfd, struct match_entry matches[], int count);
+bool send_ans_matches_shared(int sockfd, const struct match_entry matches[],
+		int count); /* server */
 bool send_ans_badreq(int sockfd);
 bool send_msg_ready(int sockfd, struct sockaddr_storage *dest);
 bool send_msg_shot(int sockfd, struct sockaddr_storage *dest,
@@ -0,0 +1,106 @@
+/*
+ * This file is part of reti2016.
+ *
+ * reti2016 is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * reti2016 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * See file LICENSE for more details.
+ */
+
+#ifndef	_BATTLE_REACTOR_H
+#define	_BATTLE_REACTOR_H
+
+#include <pthread.h>
+#include <stdint.h>
+#include <sys/uio.h>
+#include "buffer.h"
+#include "fdtable.h"
+#include "mailbox.h"
+#include "poller.h"
+
+struct game_client;
+
+/* low priority work, run by a reactor after the I/O of an iteration */
+struct deferred_work {
+	void (*fn)(void *arg);
+	void *arg;
+};
+
+/*
+ * A server thread. Each reactor accepts connections on its own listening
+ * socket (bound with SO_REUSEPORT) and owns them: only the reactor serves,
+ * writes to and closes its connections. Messages for connections owned by
+ * other reactors go through their mailbox.
+ */
+struct reactor {
+	unsigned int id;
+	struct reactor *next; /* in the list of all the reactors */
+	pthread_t thread;
+	int sfd;
+	int usfd; /* AF_UNIX listening socket, shared by all reactors (or -1) */
+	int sigfd; /* signalfd watched by this reactor (or -1) */
+	uint64_t now; /* monotonic clock in ms, read once per iteration */
+	struct poller *poller;
+	struct mailbox mailbox;
+	/* clients owned, by socket: changed by the owner with the client list
+	 * locked, so the owner reads it without locking and the other threads
+	 * with the client list locked */
+	struct fdtable clients;
+	/* clients with output queued during the current iteration */
+	struct game_client **dirty;
+	size_t dirty_count;
+	size_t dirty_size;
+	/* circular queue of the clients with input left over by the dispatch
+	 * budget (removed clients are left as NULL) */
+	struct game_client **pending;
+	size_t pending_head;
+	size_t pending_count;
+	size_t pending_size;
+	/* circular queue of the deferred work */
+	struct deferred_work *deferred;
+	size_t deferred_head;
+	size_t deferred_count;
+	size_t deferred_size;
+	/* log lines waiting to be written by the deferred work */
+	struct buffer log;
+	bool log_queued;
+	bool stopping;
+};
+
+bool reactor_init(struct reactor *r, unsigned int id, int sfd, int usfd,
+		int sigfd);
+void reactor_destroy(struct reactor *r);
+bool reactor_start(struct reactor *r, void *(*loop)(void *));
+void reactor_wake(struct reactor *r);
+void reactor_stop(struct reactor *r);
+void reactor_join(struct reactor *r);
+bool reactor_stopping(struct reactor *r);
+
+void set_current_reactor(struct reactor *r);
+struct reactor *current_reactor();
+struct game_client *reactor_client(struct reactor *r, int fd);
+struct game_client *reactor_find_client(int fd);
+
+bool reactor_send(int sockfd, const void *buf, size_t len);
+bool reactor_sendv(int sockfd, const struct iovec *iov, int iovcnt);
+bool reactor_flush(struct reactor *r, struct game_client *client);
+void reactor_flush_dirty(struct reactor *r);
+void reactor_update_interest(struct reactor *r, struct game_client *client);
+bool reactor_defer_input(struct reactor *r, struct game_client *client);
+struct game_client *reactor_next_pending(struct reactor *r);
+void reactor_forget(struct reactor *r, struct game_client *client);
+bool reactor_post_work_done(struct game_client *client);
+void reactor_deliver_mail(struct reactor *r);
+bool reactor_defer_work(struct reactor *r, void (*fn)(void *), void *arg);
+void reactor_run_deferred_work(struct reactor *r, bool all);
+void reactor_log(const char *fmt, ...)
+	__attribute__ ((format (printf, 1, 2)));
+
+#endif
@@ -17,8 +17,13 @@
 #ifndef	_BATTLE_SIGHANDLER_H
 #define	_BATTLE_SIGHANDLER_H
 
+#include <signal.h>
+
 extern unsigned int received_signal;
 
 bool sighandler_init();
+bool sighandler_block(sigset_t *oldmask);
+int sighandler_fd();
+int sighandler_read(int fd);
 
 #endif
@@ -0,0 +1,69 @@
+/*
+ * This file is part of reti2016.
+ *
+ * reti2016 is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * reti2016 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * See file LICENSE for more details.
+ */
+
+#ifndef	_BATTLE_SKIPLIST_H
+#define	_BATTLE_SKIPLIST_H
+
+#include <stddef.h>
+
+/* enough for millions of elements with a level ratio of 1/4 */
+#define	SKIPLIST_MAX_LEVEL	12
+
+/* number of elements in the skiplist */
+#define	SKIPLIST_COUNT(_sl)	((_sl)->count)
+
+/* pointer to the structure of type _type containing the link _link in the
+ * field _member */
+#define	SKIPLIST_ENTRY(_link, _type, _member)\
+		((_type *)((char *)(_link) - offsetof(_type, _member)))
+
+/*
+ * Link of an element in the skiplist, embedded in the element itself: the
+ * skiplist never allocates. key points to the element used for sorting (NULL
+ * while the link is in no skiplist) and next[i] is the next element at level
+ * i, for i < level. Every step of a
+ * search reads key and a low level of next, so they come first: the upper
+ * levels, rarely used, are left at the end.
+ */
+struct skiplist_link {
+	const char *key;
+	int level;
+	struct skiplist_link *next[SKIPLIST_MAX_LEVEL];
+};
+
+/*
+ * Skiplist of elements sorted by a string key, compared byte by byte: search,
+ * insertion and removal take O(log n) on average.
+ */
+struct skiplist {
+	struct skiplist_link head;
+	int level;
+	size_t count;
+	unsigned int seed;
+};
+
+void skiplist_init(struct skiplist *sl);
+void skiplist_insert(struct skiplist *sl, struct skiplist_link *link,
+		const char *key);
+void skiplist_remove(struct skiplist *sl, struct skiplist_link *link);
+struct skiplist_link *skiplist_search(struct skiplist *sl, const char *key);
+struct skiplist_link *skiplist_search_from(struct skiplist *sl,
+		const char *key);
+
+struct skiplist_link *skiplist_first(struct skiplist *sl);
+struct skiplist_link *skiplist_next(struct skiplist_link *link);
+
+#endif
@@ -0,0 +1,78 @@
+/*
+ * This file is part of reti2016.
+ *
+ * reti2016 is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * reti2016 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * See file LICENSE for more details.
+ */
+
+#ifndef	_BATTLE_TIMER_H
+#define	_BATTLE_TIMER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* slots per level of a timer wheel, as a power of 2, and number of levels: a
+ * slot of the level i spans 2^(i * TIMER_WHEEL_BITS) milliseconds, so that
+ * the wheel spans about 4.6 hours */
+#define	TIMER_WHEEL_BITS	6
+#define	TIMER_WHEEL_SLOTS	(1 << TIMER_WHEEL_BITS)
+#define	TIMER_WHEEL_LEVELS	4
+
+#define	TIMER_INIT(_t)	do {\
+		(_t)->next = NULL;\
+		(_t)->pprev = NULL;\
+	} while(0)
+
+/* true if the timer is waiting in a wheel */
+#define	TIMER_ARMED(_t)	((_t)->pprev != NULL)
+
+/* pointer to the structure of type _type containing the timer _timer in the
+ * field _member */
+#define	TIMER_ENTRY(_timer, _type, _member)\
+		((_type *)((char *)(_timer) - offsetof(_type, _member)))
+
+/*
+ * Timer embedded in the object it belongs to: the wheel never allocates.
+ * expire is called once the deadline, in milliseconds of the monotonic clock,
+ * has passed; the timer is no longer armed at that point.
+ */
+struct timer {
+	struct timer *next;
+	struct timer **pprev;
+	uint64_t deadline;
+	void (*expire)(struct timer *t);
+};
+
+/*
+ * Hierarchical timing wheel. Every level is a ring of slots, each one a list
+ * of timers: a timer waits in the lowest level whose ring reaches its
+ * deadline and moves down a level when the wheel turns to its slot, so
+ * adding, cancelling and expiring a timer take O(1). Deadlines beyond the
+ * span of the wheel are reconsidered when the span has elapsed. A wheel is
+ * not thread safe: the callers must serialize the accesses.
+ */
+struct timer_wheel {
+	uint64_t current; /* last millisecond processed */
+	uint64_t used[TIMER_WHEEL_LEVELS]; /* slots that may have timers */
+	struct timer *slots[TIMER_WHEEL_LEVELS][TIMER_WHEEL_SLOTS];
+};
+
+uint64_t timer_clock();
+
+void timer_wheel_init(struct timer_wheel *w, uint64_t now);
+void timer_wheel_advance(struct timer_wheel *w, uint64_t now);
+int timer_wheel_timeout(struct timer_wheel *w, uint64_t now);
+
+void timer_add(struct timer_wheel *w, struct timer *t, uint64_t deadline);
+void timer_cancel(struct timer *t);
+
+#endif
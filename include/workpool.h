@@ -0,0 +1,64 @@
+/*
+ * This file is part of reti2016.
+ *
+ * reti2016 is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * reti2016 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * See file LICENSE for more details.
+ */
+
+#ifndef	_BATTLE_WORKPOOL_H
+#define	_BATTLE_WORKPOOL_H
+
+#include <stddef.h>
+#include <pthread.h>
+
+struct game_client;
+
+/* request of a client served by a worker */
+struct work_item {
+	void (*fn)(void);
+	struct game_client *client;
+};
+
+struct worker {
+	struct workpool *wp;
+	pthread_t thread;
+	/* client of the running job (NULL if none or forgotten) */
+	struct game_client *client;
+};
+
+/*
+ * Threads doing the work that takes long for the requests of the clients,
+ * off the server threads. A job doesn't touch its client, which can be
+ * removed meanwhile, and takes the locks it needs by itself: once it is over,
+ * the reactor owning the client is notified through its mailbox, and answers
+ * the request.
+ */
+struct workpool {
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	/* circular queue of the jobs (forgotten clients are left as NULL) */
+	struct work_item *queue;
+	size_t head;
+	size_t count;
+	size_t size;
+	struct worker *workers;
+	unsigned int nthreads;
+	bool stopping;
+};
+
+bool workpool_init(struct workpool *wp, unsigned int nthreads);
+void workpool_destroy(struct workpool *wp);
+bool workpool_submit(struct workpool *wp, void (*fn)(void),
+		struct game_client *client);
+void workpool_forget(struct workpool *wp, struct game_client *client);
+
+#endif
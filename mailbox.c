@@ -0,0 +1,207 @@
+/*
+ * This file is part of reti2016.
+ *
+ * reti2016 is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * reti2016 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * See file LICENSE for more details.
+ */
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include "console.h"
+#include "mailbox.h"
+
+bool mailbox_init(struct mailbox *mb)
+{
+	errno = 0;
+	mb->efd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (mb->efd == -1) {
+		print_error("eventfd", errno);
+		return false;
+	}
+
+	pthread_mutex_init(&mb->lock, NULL);
+	mb->head = mb->tail = NULL;
+	pool_init(&mb->pool, "mail", sizeof(struct mail) + MAIL_POOL_DATA_SIZE,
+			POOL_SLAB_OBJECTS);
+	return true;
+}
+
+/*
+ * Frees a mail. Must be called with the mailbox locked.
+ */
+static void free_mail(struct mailbox *mb, struct mail *m)
+{
+	if (m->len > MAIL_POOL_DATA_SIZE)
+		free(m);
+	else
+		pool_free(&mb->pool, m);
+}
+
+void mailbox_destroy(struct mailbox *mb)
+{
+	struct mail *m, *next;
+
+	for (m = mb->head; m; m = next) {
+		next = m->next;
+		free_mail(mb, m);
+	}
+	mb->head = mb->tail = NULL;
+
+	pool_destroy(&mb->pool);
+	pthread_mutex_destroy(&mb->lock);
+	close(mb->efd);
+}
+
+/*
+ * Wakes up the owner of the mailbox, even if there is no mail.
+ */
+void mailbox_wake(struct mailbox *mb)
+{
+	uint64_t one = 1;
+
+	if (write(mb->efd, &one, sizeof(one)) == -1 && errno != EAGAIN)
+		print_error("write", errno);
+}
+
+/*
+ * Copies the iovcnt buffers in iov, one after the other, in a new mail for
+ * target. The owner is woken up only if the mailbox was empty.
+ */
+bool mailbox_postv(struct mailbox *mb, void *target, const struct iovec *iov,
+		int iovcnt)
+{
+	struct mail *m = NULL;
+	bool was_empty;
+	size_t len;
+	char *dst;
+	int i;
+
+	for (i = 0, len = 0; i < iovcnt; i++)
+		len += iov[i].iov_len;
+
+	if (len > MAIL_POOL_DATA_SIZE) {
+		errno = 0;
+		m = malloc(sizeof(struct mail) + len);
+		if (!m) {
+			print_error("malloc", errno);
+			return false;
+		}
+	}
+
+	pthread_mutex_lock(&mb->lock);
+	if (!m && !(m = pool_alloc(&mb->pool))) {
+		pthread_mutex_unlock(&mb->lock);
+		return false;
+	}
+	m->target = target;
+	m->next = NULL;
+	m->len = len;
+	for (i = 0, dst = m->data; i < iovcnt; dst += iov[i].iov_len, i++)
+		memcpy(dst, iov[i].iov_base, iov[i].iov_len);
+
+	was_empty = !mb->head;
+	if (was_empty)
+		mb->head = m;
+	else
+		mb->tail->next = m;
+	mb->tail = m;
+	pthread_mutex_unlock(&mb->lock);
+
+	if (was_empty)
+		mailbox_wake(mb);
+	return true;
+}
+
+/*
+ * Copies len bytes pointed by data in a new mail for target.
+ */
+bool mailbox_post(struct mailbox *mb, void *target, const void *data,
+		size_t len)
+{
+	struct iovec iov;
+
+	iov.iov_base = (void *)data;
+	iov.iov_len = len;
+	return mailbox_postv(mb, target, &iov, 1);
+}
+
+/*
+ * Detaches and returns all the mail, in the order it has been posted. The
+ * caller must release it with mailbox_release().
+ */
+struct mail *mailbox_take(struct mailbox *mb)
+{
+	struct mail *m;
+	uint64_t count;
+
+	/* reset the counter of the eventfd */
+	if (read(mb->efd, &count, sizeof(count)) == -1 && errno != EAGAIN)
+		print_error("read", errno);
+
+	pthread_mutex_lock(&mb->lock);
+	m = mb->head;
+	mb->head = mb->tail = NULL;
+	pthread_mutex_unlock(&mb->lock);
+
+	return m;
+}
+
+/*
+ * Frees the mail returned by mailbox_take().
+ */
+void mailbox_release(struct mailbox *mb, struct mail *m)
+{
+	struct mail *next;
+
+	if (!m)
+		return;
+
+	pthread_mutex_lock(&mb->lock);
+	for (; m; m = next) {
+		next = m->next;
+		free_mail(mb, m);
+	}
+	pthread_mutex_unlock(&mb->lock);
+}
+
+/*
+ * Deletes all the mail for target (used when target is going away).
+ */
+void mailbox_forget(struct mailbox *mb, void *target)
+{
+	struct mail **p, *m;
+
+	pthread_mutex_lock(&mb->lock);
+	mb->tail = NULL;
+	for (p = &mb->head; *p;) {
+		m = *p;
+		if (m->target == target) {
+			*p = m->next;
+			free_mail(mb, m);
+		} else {
+			mb->tail = m;
+			p = &m->next;
+		}
+	}
+	pthread_mutex_unlock(&mb->lock);
+}
+
+void mailbox_print_stats(struct mailbox *mb)
+{
+	pthread_mutex_lock(&mb->lock);
+	pool_print_stats(&mb->pool);
+	pthread_mutex_unlock(&mb->lock);
+}
@@ -19,18 +19,27 @@
 #include <string.h>
 #include <unistd.h>
 #include <arpa/inet.h>
+#include <netinet/tcp.h>
+#include <sys/un.h>
 #include <sys/ioctl.h>
+#include <sys/stat.h>
 #include "console.h"
 #include "netutil.h"
 
 /*
  * Open a new listening socket from any address on the port specified by port.
- * The socked descriptor is returned.
+ * If reuse_port is true, other sockets can listen on the same port and the
+ * kernel balances the incoming connections among them (SO_REUSEPORT).
+ * If defer_secs is positive, connections are reported only when data arrives
+ * or after about defer_secs seconds (TCP_DEFER_ACCEPT).
+ * The socket is non-blocking, so that pending connections can be accepted
+ * until the queue is empty. The socked descriptor is returned.
  */
-int listen_on_port(in_port_t port)
+int listen_on_port(in_port_t port, bool reuse_port, int defer_secs)
 {
 	struct sockaddr_storage sa;
 	int sfd;
+	int on = 1;
 
 	memset(&sa, 0, sizeof(struct sockaddr_storage));
 	sa.ss_family = ADDRESS_FAMILY;
@@ -41,11 +50,24 @@ int listen_on_port(in_port_t port)
 #endif
 
 	errno = 0;
-	if (-1 == (sfd = socket(sa.ss_family, SOCK_STREAM, 0))) {
+	sfd = socket(sa.ss_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if (sfd == -1) {
 		print_error("socket", errno);
 		return -1;
 	}
 
+	if (reuse_port && setsockopt(sfd, SOL_SOCKET, SO_REUSEPORT, &on,
+				sizeof(on)) != 0) {
+		print_error("setsockopt", errno);
+		goto exit_close_sock;
+	}
+
+	if (defer_secs > 0 && setsockopt(sfd, IPPROTO_TCP, TCP_DEFER_ACCEPT,
+				&defer_secs, sizeof(defer_secs)) != 0) {
+		print_error("setsockopt", errno);
+		goto exit_close_sock;
+	}
+
 	while (bind(sfd, (struct sockaddr *)&sa,
 			STRUCT_SOCKADDR_SIZE) != 0) {
 		print_error("bind", errno);
@@ -67,10 +89,110 @@ exit_close_sock:
 	return -1;
 }
 
+/*
+ * Fills the AF_UNIX address pointed by sa with path. Returns false if the
+ * path is too long.
+ */
+static bool fill_unix_sockaddr(struct sockaddr_un *sa, const char *path)
+{
+	memset(sa, 0, sizeof(struct sockaddr_un));
+	sa->sun_family = AF_UNIX;
+	if (strlen(path) >= sizeof(sa->sun_path)) {
+		printf_error("Unix socket path too long: %s", path);
+		return false;
+	}
+	strcpy(sa->sun_path, path);
+	return true;
+}
+
+/*
+ * Makes path free for a new AF_UNIX socket: a stale socket file left by a
+ * previous run is removed, while a socket where a server is still listening
+ * (it accepts a connection) or a file of another kind is left alone.
+ * Returns false if path cannot be used.
+ */
+static bool free_unix_socket_path(const char *path, struct sockaddr_un *sa)
+{
+	struct stat st;
+	int fd;
+	bool stale;
+
+	errno = 0;
+	if (lstat(path, &st) == -1) {
+		if (errno == ENOENT)
+			return true;
+		print_error("lstat", errno);
+		return false;
+	}
+	if (!S_ISSOCK(st.st_mode)) {
+		printf_error("Unix socket path is not a socket: %s", path);
+		return false;
+	}
+
+	if (-1 == (fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0))) {
+		print_error("socket", errno);
+		return false;
+	}
+	stale = connect(fd, (struct sockaddr *)sa,
+			sizeof(struct sockaddr_un)) == -1 &&
+		errno == ECONNREFUSED;
+	close(fd);
+
+	if (!stale) {
+		printf_error("Unix socket path in use by another server: %s", path);
+		return false;
+	}
+	if (unlink(path) == -1 && errno != ENOENT) {
+		print_error("unlink", errno);
+		return false;
+	}
+	return true;
+}
+
+/*
+ * Opens a new listening socket on the AF_UNIX stream socket path, replacing
+ * a stale socket file left by a previous run (see free_unix_socket_path()).
+ * Like listen_on_port(), the socket is non-blocking. The socket descriptor is
+ * returned.
+ */
+int listen_on_unix_socket(const char *path)
+{
+	struct sockaddr_un sa;
+	int sfd;
+
+	if (!fill_unix_sockaddr(&sa, path) ||
+			!free_unix_socket_path(path, &sa))
+		return -1;
+
+	errno = 0;
+	sfd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if (sfd == -1) {
+		print_error("socket", errno);
+		return -1;
+	}
+
+	if (bind(sfd, (struct sockaddr *)&sa, sizeof(struct sockaddr_un)) != 0) {
+		print_error("bind", errno);
+		goto exit_close_sock;
+	}
+	if (listen(sfd, LISTEN_BACKLOG) != 0) {
+		print_error("listen", errno);
+		unlink(path);
+		goto exit_close_sock;
+	}
+
+	return sfd;
+
+exit_close_sock:
+	close(sfd);
+	return -1;
+}
+
 /*
  * Accept a new connection on the listening socket specified by sockfd. Returns
- * the newly created connection socket and saves the client address in the
- * memory area pointed by sa.
+ * the newly created connection socket (non-blocking and closed on exec) and
+ * saves the client address in the memory area pointed by sa. Returns -1 with
+ * errno set to EAGAIN, without printing an error, if no connection is pending.
  */
 int accept_socket_connection(int sockfd, struct sockaddr_storage *sa)
 {
@@ -79,10 +201,10 @@ int accept_socket_connection(int sockfd, struct sockaddr_storage *sa)
 
 	errno = 0;
 	len = STRUCT_SOCKADDR_SIZE;
-	if (-1 == (connfd = accept(sockfd, (struct sockaddr *)sa, &len))) {
-		print_error("accept", errno);
-		return -1;
-	}
+	connfd = accept4(sockfd, (struct sockaddr *)sa, &len,
+			SOCK_NONBLOCK | SOCK_CLOEXEC);
+	if (connfd == -1 && errno != EAGAIN && errno != EWOULDBLOCK)
+		print_error("accept4", errno);
 
 	return connfd;
 }
@@ -289,3 +411,31 @@ int connect_to_server(struct in_addr addr, in_port_t port)
 
 	return sfd;
 }
+
+/*
+ * Connects to a server listening on the AF_UNIX stream socket path and
+ * returns the connection socket.
+ */
+int connect_to_unix_socket(const char *path)
+{
+	struct sockaddr_un sa;
+	int sfd;
+
+	if (!fill_unix_sockaddr(&sa, path))
+		return -1;
+
+	errno = 0;
+	if (-1 == (sfd = socket(AF_UNIX, SOCK_STREAM, 0))) {
+		print_error("socket", errno);
+		return -1;
+	}
+
+	if (connect(sfd, (struct sockaddr *)&sa,
+				sizeof(struct sockaddr_un)) == -1) {
+		print_error("connect", errno);
+		close(sfd);
+		return -1;
+	}
+
+	return sfd;
+}
@@ -0,0 +1,728 @@
+/*
+ * This file is part of reti2016.
+ *
+ * reti2016 is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * reti2016 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * See file LICENSE for more details.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#if defined(USE_IO_URING) && USE_IO_URING == 1
+#include <poll.h>
+#include <signal.h>
+#include <time.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#endif
+#include "console.h"
+#include "poller.h"
+
+#if defined(USE_IO_URING) && USE_IO_URING == 1
+/*
+ * Requests submitted to the io_uring instance. The kind of request, the
+ * generation of the descriptor and the descriptor itself are packed in the
+ * user_data field, so completions can be routed without any lookup.
+ */
+enum uring_op { OP_ACCEPT, OP_RECV, OP_POLL_IN, OP_POLL_OUT, OP_CANCEL };
+
+#define	URING_USER_DATA(_op, _gen, _fd)	(((__u64)(_op) << 56) |\
+				((__u64)((_gen) & 0xFFFFFF) << 32) |\
+				(__u32)(_fd))
+#define	URING_OP(_ud)		((enum uring_op)((_ud) >> 56))
+#define	URING_GEN(_ud)		((unsigned int)((_ud) >> 32) & 0xFFFFFF)
+#define	URING_FD(_ud)		((int)(__u32)(_ud))
+
+/* buffer group of the provided receive buffers */
+#define	URING_BGID		0
+
+/*
+ * State of a registered descriptor. interest holds the watched events, armed
+ * the events with a request in flight and cancelling the requests that are
+ * being cancelled. gen is bumped every time the descriptor is removed, so
+ * late completions of a closed (and maybe reused) descriptor are discarded.
+ */
+struct uring_fd {
+	unsigned int gen;
+	unsigned int interest;
+	unsigned int armed;
+	unsigned int cancelling;
+};
+
+struct uring {
+	int fd;
+	unsigned int sq_entries;
+	unsigned int *sq_head;
+	unsigned int *sq_tail;
+	unsigned int *sq_mask;
+	unsigned int *sq_array;
+	unsigned int sq_local_tail;
+	unsigned int pending;
+	struct io_uring_sqe *sqes;
+	unsigned int *cq_head;
+	unsigned int *cq_tail;
+	unsigned int *cq_mask;
+	struct io_uring_cqe *cqes;
+	void *sq_ring;
+	size_t sq_ring_size;
+	void *cq_ring;
+	size_t cq_ring_size;
+	size_t sqes_size;
+	struct io_uring_buf_ring *buf_ring;
+	size_t buf_ring_size;
+	unsigned short buf_tail;
+	char *bufs;
+	unsigned short recycle[POLLER_MAX_EVENTS];
+	int recycle_count;
+	struct uring_fd *fds;
+	int nfds;
+};
+#endif
+
+/*
+ * The poller is a thin wrapper around an epoll instance or, when available
+ * and enabled, an io_uring instance. With epoll the kernel keeps the interest
+ * list, so each wait only returns (and costs) the ready descriptors. With
+ * io_uring, listening sockets and connected sockets are served by multishot
+ * accept and multishot recv requests: the poller reports the accepted socket
+ * and the received bytes directly, with no further system call.
+ */
+struct poller {
+	int epfd;
+	struct epoll_event events[POLLER_MAX_EVENTS];
+#if defined(USE_IO_URING) && USE_IO_URING == 1
+	struct uring *uring;
+#endif
+};
+
+static uint32_t to_epoll_events(unsigned int events)
+{
+	uint32_t ev = 0;
+
+	if (events & (POLLER_IN | POLLER_ACCEPT | POLLER_RECV))
+		ev |= EPOLLIN;
+	if (events & POLLER_OUT)
+		ev |= EPOLLOUT;
+	if (events & POLLER_EXCLUSIVE)
+		ev |= EPOLLEXCLUSIVE;
+	return ev;
+}
+
+static unsigned int from_epoll_events(uint32_t ev)
+{
+	unsigned int events = 0;
+
+	if (ev & EPOLLIN)
+		events |= POLLER_IN;
+	if (ev & EPOLLOUT)
+		events |= POLLER_OUT;
+	if (ev & (EPOLLHUP | EPOLLERR))
+		events |= POLLER_HUP;
+	return events;
+}
+
+#if defined(USE_IO_URING) && USE_IO_URING == 1
+static int io_uring_setup(unsigned int entries, struct io_uring_params *p)
+{
+	return syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int io_uring_enter(int fd, unsigned int to_submit,
+		unsigned int min_complete, unsigned int flags, void *arg,
+		size_t argsz)
+{
+	return syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags,
+			arg, argsz);
+}
+
+static int io_uring_register(int fd, unsigned int opcode, void *arg,
+		unsigned int nr_args)
+{
+	return syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+static void uring_destroy(struct uring *u)
+{
+	if (u->bufs)
+		free(u->bufs);
+	if (u->buf_ring)
+		munmap(u->buf_ring, u->buf_ring_size);
+	if (u->sqes)
+		munmap(u->sqes, u->sqes_size);
+	if (u->cq_ring && u->cq_ring != u->sq_ring)
+		munmap(u->cq_ring, u->cq_ring_size);
+	if (u->sq_ring)
+		munmap(u->sq_ring, u->sq_ring_size);
+	if (u->fds)
+		free(u->fds);
+	close(u->fd);
+	free(u);
+}
+
+/*
+ * Gives the receive buffer bid back to the kernel. The new tail is published
+ * by uring_publish_buffers().
+ */
+static void uring_add_buffer(struct uring *u, unsigned short bid)
+{
+	struct io_uring_buf *buf;
+
+	buf = &u->buf_ring->bufs[u->buf_tail & (URING_BUFFER_COUNT - 1)];
+	buf->addr = (unsigned long)(u->bufs + (size_t)bid * URING_BUFFER_SIZE);
+	buf->len = URING_BUFFER_SIZE;
+	buf->bid = bid;
+	u->buf_tail++;
+}
+
+static void uring_publish_buffers(struct uring *u)
+{
+	__atomic_store_n(&u->buf_ring->tail, u->buf_tail, __ATOMIC_RELEASE);
+}
+
+/*
+ * Maps the rings of a new io_uring instance and registers the ring of
+ * provided buffers used by multishot recv. Returns NULL (silently, so that
+ * the caller can fall back to epoll) if io_uring is not available.
+ */
+static struct uring *uring_create()
+{
+	struct uring *u;
+	struct io_uring_params p;
+	struct io_uring_buf_reg reg;
+	int i;
+
+	errno = 0;
+	u = calloc(1, sizeof(struct uring));
+	if (!u) {
+		print_error("calloc", errno);
+		return NULL;
+	}
+
+	memset(&p, 0, sizeof(struct io_uring_params));
+	if (-1 == (u->fd = io_uring_setup(URING_QUEUE_DEPTH, &p))) {
+		free(u);
+		return NULL;
+	}
+	if (!(p.features & IORING_FEAT_EXT_ARG))
+		goto exit_destroy;
+
+	u->sq_ring_size = p.sq_off.array + p.sq_entries * sizeof(__u32);
+	u->cq_ring_size = p.cq_off.cqes +
+		p.cq_entries * sizeof(struct io_uring_cqe);
+	if (p.features & IORING_FEAT_SINGLE_MMAP) {
+		if (u->cq_ring_size > u->sq_ring_size)
+			u->sq_ring_size = u->cq_ring_size;
+		u->cq_ring_size = u->sq_ring_size;
+	}
+
+	u->sq_ring = mmap(NULL, u->sq_ring_size, PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_POPULATE, u->fd, IORING_OFF_SQ_RING);
+	if (u->sq_ring == MAP_FAILED) {
+		u->sq_ring = NULL;
+		goto exit_destroy;
+	}
+	if (p.features & IORING_FEAT_SINGLE_MMAP) {
+		u->cq_ring = u->sq_ring;
+	} else {
+		u->cq_ring = mmap(NULL, u->cq_ring_size,
+				PROT_READ | PROT_WRITE,
+				MAP_SHARED | MAP_POPULATE, u->fd,
+				IORING_OFF_CQ_RING);
+		if (u->cq_ring == MAP_FAILED) {
+			u->cq_ring = NULL;
+			goto exit_destroy;
+		}
+	}
+	u->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+	u->sqes = mmap(NULL, u->sqes_size, PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_POPULATE, u->fd, IORING_OFF_SQES);
+	if (u->sqes == MAP_FAILED) {
+		u->sqes = NULL;
+		goto exit_destroy;
+	}
+
+	u->sq_entries = p.sq_entries;
+	u->sq_head = (unsigned int *)((char *)u->sq_ring + p.sq_off.head);
+	u->sq_tail = (unsigned int *)((char *)u->sq_ring + p.sq_off.tail);
+	u->sq_mask = (unsigned int *)((char *)u->sq_ring + p.sq_off.ring_mask);
+	u->sq_array = (unsigned int *)((char *)u->sq_ring + p.sq_off.array);
+	u->sq_local_tail = *u->sq_tail;
+	u->cq_head = (unsigned int *)((char *)u->cq_ring + p.cq_off.head);
+	u->cq_tail = (unsigned int *)((char *)u->cq_ring + p.cq_off.tail);
+	u->cq_mask = (unsigned int *)((char *)u->cq_ring + p.cq_off.ring_mask);
+	u->cqes = (struct io_uring_cqe *)((char *)u->cq_ring + p.cq_off.cqes);
+
+	u->buf_ring_size = URING_BUFFER_COUNT * sizeof(struct io_uring_buf);
+	u->buf_ring = mmap(NULL, u->buf_ring_size, PROT_READ | PROT_WRITE,
+			MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (u->buf_ring == MAP_FAILED) {
+		u->buf_ring = NULL;
+		goto exit_destroy;
+	}
+	u->bufs = malloc((size_t)URING_BUFFER_COUNT * URING_BUFFER_SIZE);
+	if (!u->bufs)
+		goto exit_destroy;
+
+	memset(&reg, 0, sizeof(struct io_uring_buf_reg));
+	reg.ring_addr = (unsigned long)u->buf_ring;
+	reg.ring_entries = URING_BUFFER_COUNT;
+	reg.bgid = URING_BGID;
+	if (io_uring_register(u->fd, IORING_REGISTER_PBUF_RING, &reg, 1) == -1)
+		goto exit_destroy;
+
+	for (i = 0; i < URING_BUFFER_COUNT; i++)
+		uring_add_buffer(u, i);
+	uring_publish_buffers(u);
+
+	return u;
+
+exit_destroy:
+	uring_destroy(u);
+	return NULL;
+}
+
+/*
+ * Submits the queued requests and, if min_complete is not zero, waits up to
+ * timeout milliseconds for completions.
+ */
+static int uring_submit(struct uring *u, unsigned int min_complete,
+		int timeout)
+{
+	struct io_uring_getevents_arg arg;
+	struct timespec ts;
+	unsigned int flags;
+	int ret;
+
+	__atomic_store_n(u->sq_tail, u->sq_local_tail, __ATOMIC_RELEASE);
+
+	flags = min_complete ? IORING_ENTER_GETEVENTS : 0;
+	memset(&arg, 0, sizeof(struct io_uring_getevents_arg));
+	if (min_complete && timeout >= 0) {
+		ts.tv_sec = timeout / 1000;
+		ts.tv_nsec = (timeout % 1000) * 1000000L;
+		arg.sigmask_sz = _NSIG / 8;
+		arg.ts = (unsigned long)&ts;
+		flags |= IORING_ENTER_EXT_ARG;
+	}
+
+	ret = io_uring_enter(u->fd, u->pending, min_complete, flags,
+			(flags & IORING_ENTER_EXT_ARG) ? &arg : NULL,
+			(flags & IORING_ENTER_EXT_ARG) ? sizeof(arg) : 0);
+	if (ret >= 0)
+		u->pending -= ret;
+	return ret;
+}
+
+static struct io_uring_sqe *uring_get_sqe(struct uring *u)
+{
+	struct io_uring_sqe *sqe;
+	unsigned int index;
+
+	while (u->sq_local_tail - __atomic_load_n(u->sq_head, __ATOMIC_ACQUIRE)
+			>= u->sq_entries)
+		if (uring_submit(u, 0, 0) == -1 && errno != EINTR &&
+				errno != EAGAIN && errno != EBUSY)
+			return NULL;
+
+	index = u->sq_local_tail & *u->sq_mask;
+	sqe = &u->sqes[index];
+	memset(sqe, 0, sizeof(struct io_uring_sqe));
+	u->sq_array[index] = index;
+	u->sq_local_tail++;
+	u->pending++;
+	return sqe;
+}
+
+/*
+ * Grows the descriptor state array so that fd is a valid index.
+ */
+static struct uring_fd *uring_get_fd(struct uring *u, int fd)
+{
+	struct uring_fd *fds;
+	int n;
+
+	if (fd < u->nfds)
+		return &u->fds[fd];
+
+	for (n = u->nfds ? u->nfds : 64; n <= fd; n *= 2)
+		;
+
+	errno = 0;
+	fds = realloc(u->fds, n * sizeof(struct uring_fd));
+	if (!fds) {
+		print_error("realloc", errno);
+		return NULL;
+	}
+	memset(fds + u->nfds, 0, (n - u->nfds) * sizeof(struct uring_fd));
+	u->fds = fds;
+	u->nfds = n;
+	return &u->fds[fd];
+}
+
+static bool uring_arm(struct uring *u, int fd, struct uring_fd *f,
+		unsigned int event)
+{
+	struct io_uring_sqe *sqe;
+
+	if (!(sqe = uring_get_sqe(u)))
+		return false;
+
+	sqe->fd = fd;
+	switch (event) {
+	case POLLER_ACCEPT:
+		sqe->opcode = IORING_OP_ACCEPT;
+		sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+		sqe->accept_flags = SOCK_NONBLOCK | SOCK_CLOEXEC;
+		sqe->user_data = URING_USER_DATA(OP_ACCEPT, f->gen, fd);
+		break;
+	case POLLER_RECV:
+		sqe->opcode = IORING_OP_RECV;
+		sqe->ioprio = IORING_RECV_MULTISHOT;
+		sqe->flags = IOSQE_BUFFER_SELECT;
+		sqe->buf_group = URING_BGID;
+		sqe->user_data = URING_USER_DATA(OP_RECV, f->gen, fd);
+		break;
+	case POLLER_IN:
+		sqe->opcode = IORING_OP_POLL_ADD;
+		sqe->poll32_events = POLLIN;
+		sqe->len = IORING_POLL_ADD_MULTI;
+		sqe->user_data = URING_USER_DATA(OP_POLL_IN, f->gen, fd);
+		break;
+	case POLLER_OUT:
+		sqe->opcode = IORING_OP_POLL_ADD;
+		sqe->poll32_events = POLLOUT;
+		sqe->user_data = URING_USER_DATA(OP_POLL_OUT, f->gen, fd);
+		break;
+	}
+
+	f->armed |= event;
+	return true;
+}
+
+static bool uring_cancel(struct uring *u, int fd, struct uring_fd *f,
+		unsigned int event)
+{
+	struct io_uring_sqe *sqe;
+	enum uring_op op;
+
+	if (!(sqe = uring_get_sqe(u)))
+		return false;
+
+	switch (event) {
+	case POLLER_ACCEPT:
+		op = OP_ACCEPT;
+		break;
+	case POLLER_RECV:
+		op = OP_RECV;
+		break;
+	case POLLER_IN:
+		op = OP_POLL_IN;
+		break;
+	case POLLER_OUT:
+	default:
+		op = OP_POLL_OUT;
+	}
+
+	sqe->opcode = IORING_OP_ASYNC_CANCEL;
+	sqe->fd = -1;
+	sqe->addr = URING_USER_DATA(op, f->gen, fd);
+	sqe->user_data = URING_USER_DATA(OP_CANCEL, f->gen, fd);
+	f->cancelling |= event;
+	return true;
+}
+
+/*
+ * Brings the requests in flight for fd in line with the watched events: arms
+ * a request for every watched event without one and cancels the requests of
+ * the events no longer watched.
+ */
+static bool uring_sync_fd(struct uring *u, int fd, struct uring_fd *f)
+{
+	static const unsigned int all[] = {POLLER_ACCEPT, POLLER_RECV,
+		POLLER_IN, POLLER_OUT, 0};
+	int i;
+
+	for (i = 0; all[i]; i++) {
+		if ((f->interest & all[i]) && !(f->armed & all[i]) &&
+				!uring_arm(u, fd, f, all[i]))
+			return false;
+		if (!(f->interest & all[i]) && (f->armed & all[i]) &&
+				!(f->cancelling & all[i]) &&
+				!uring_cancel(u, fd, f, all[i]))
+			return false;
+	}
+	return true;
+}
+
+static bool uring_watch(struct uring *u, int fd, unsigned int events)
+{
+	struct uring_fd *f;
+
+	if (!(f = uring_get_fd(u, fd)))
+		return false;
+
+	f->interest = events;
+	if (!uring_sync_fd(u, fd, f)) {
+		print_error("io_uring: submission queue full", 0);
+		return false;
+	}
+	return true;
+}
+
+/*
+ * Stops watching fd: the pending requests are cancelled and their late
+ * completions discarded, even if the descriptor is reused in the meantime.
+ */
+static bool uring_unwatch(struct uring *u, int fd)
+{
+	struct uring_fd *f;
+
+	if (!(f = uring_get_fd(u, fd)))
+		return false;
+
+	f->interest = 0;
+	if (!uring_sync_fd(u, fd, f))
+		print_error("io_uring: submission queue full", 0);
+
+	f->gen++;
+	f->armed = f->cancelling = 0;
+	return true;
+}
+
+/*
+ * Translates a completion in an event. Returns false if the completion does
+ * not produce an event (e.g. it belongs to a removed descriptor).
+ */
+static bool uring_complete(struct uring *u, struct io_uring_cqe *cqe,
+		struct poller_event *ev)
+{
+	enum uring_op op = URING_OP(cqe->user_data);
+	int fd = URING_FD(cqe->user_data);
+	struct uring_fd *f;
+	unsigned int event;
+	bool buffer, stale;
+
+	buffer = cqe->flags & IORING_CQE_F_BUFFER;
+	f = (fd >= 0 && fd < u->nfds) ? &u->fds[fd] : NULL;
+	stale = !f || op == OP_CANCEL || f->gen != URING_GEN(cqe->user_data);
+
+	if (stale) {
+		if (buffer)
+			uring_add_buffer(u,
+				cqe->flags >> IORING_CQE_BUFFER_SHIFT);
+		return false;
+	}
+
+	switch (op) {
+	case OP_ACCEPT:
+		event = POLLER_ACCEPT;
+		break;
+	case OP_RECV:
+		event = POLLER_RECV;
+		break;
+	case OP_POLL_IN:
+		event = POLLER_IN;
+		break;
+	case OP_POLL_OUT:
+	default:
+		event = POLLER_OUT;
+	}
+
+	/* the request is over: arm it again at the next submission if the
+	 * event is still watched */
+	if (!(cqe->flags & IORING_CQE_F_MORE)) {
+		f->armed &= ~event;
+		f->cancelling &= ~event;
+		if (cqe->res != 0 || op != OP_RECV)
+			uring_sync_fd(u, fd, f);
+	}
+
+	if (cqe->res == -ECANCELED || (op == OP_RECV && cqe->res == -ENOBUFS))
+		return false;
+
+	ev->fd = fd;
+	ev->events = event;
+	ev->result = cqe->res;
+	ev->data = NULL;
+	if ((op == OP_POLL_IN || op == OP_POLL_OUT) &&
+			(cqe->res < 0 || (cqe->res & (POLLHUP | POLLERR))))
+		ev->events |= POLLER_HUP;
+
+	if (buffer) {
+		unsigned short bid = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+
+		ev->data = u->bufs + (size_t)bid * URING_BUFFER_SIZE;
+		u->recycle[u->recycle_count++] = bid;
+	}
+	return true;
+}
+
+static int uring_wait(struct uring *u, struct poller_event *events,
+		int maxevents, int timeout)
+{
+	unsigned int head, tail;
+	int ready, i;
+
+	/* the buffers of the previous batch have been consumed by now */
+	for (i = 0; i < u->recycle_count; i++)
+		uring_add_buffer(u, u->recycle[i]);
+	u->recycle_count = 0;
+	uring_publish_buffers(u);
+
+	head = *u->cq_head;
+	tail = __atomic_load_n(u->cq_tail, __ATOMIC_ACQUIRE);
+	if (uring_submit(u, head == tail ? 1 : 0, timeout) == -1) {
+		if (errno == ETIME)
+			return 0;
+		if (errno != EBUSY && errno != EAGAIN)
+			return -1;
+	}
+
+	ready = 0;
+	head = *u->cq_head;
+	tail = __atomic_load_n(u->cq_tail, __ATOMIC_ACQUIRE);
+	for (; head != tail && ready < maxevents; head++)
+		if (uring_complete(u, &u->cqes[head & *u->cq_mask],
+					&events[ready]))
+			ready++;
+	__atomic_store_n(u->cq_head, head, __ATOMIC_RELEASE);
+	uring_publish_buffers(u);
+
+	return ready;
+}
+#endif
+
+struct poller *poller_create()
+{
+	struct poller *poller;
+
+	errno = 0;
+	poller = malloc(sizeof(struct poller));
+	if (!poller) {
+		print_error("malloc", errno);
+		return NULL;
+	}
+
+#if defined(USE_IO_URING) && USE_IO_URING == 1
+	poller->epfd = -1;
+	if ((poller->uring = uring_create()))
+		return poller;
+	puts("io_uring is not available: falling back to epoll");
+#endif
+
+	if (-1 == (poller->epfd = epoll_create1(EPOLL_CLOEXEC))) {
+		print_error("epoll_create1", errno);
+		free(poller);
+		return NULL;
+	}
+
+	return poller;
+}
+
+void poller_destroy(struct poller *poller)
+{
+	if (!poller)
+		return;
+
+#if defined(USE_IO_URING) && USE_IO_URING == 1
+	if (poller->uring)
+		uring_destroy(poller->uring);
+#endif
+	if (poller->epfd != -1)
+		close(poller->epfd);
+	free(poller);
+}
+
+static bool poller_ctl(struct poller *poller, int op, int fd,
+		unsigned int events)
+{
+	struct epoll_event ev;
+
+	ev.events = to_epoll_events(events);
+	ev.data.fd = fd;
+
+	errno = 0;
+	if (epoll_ctl(poller->epfd, op, fd, &ev) == -1) {
+		print_error("epoll_ctl", errno);
+		return false;
+	}
+	return true;
+}
+
+/*
+ * Starts watching fd for the specified events. POLLER_ACCEPT must be used
+ * for listening sockets and POLLER_RECV for connected stream sockets: with
+ * io_uring they are reported together with the accepted socket or the
+ * received data, while with epoll they are reported as POLLER_IN.
+ */
+bool poller_add(struct poller *poller, int fd, unsigned int events)
+{
+#if defined(USE_IO_URING) && USE_IO_URING == 1
+	if (poller->uring)
+		return uring_watch(poller->uring, fd,
+				events & ~POLLER_EXCLUSIVE);
+#endif
+	return poller_ctl(poller, EPOLL_CTL_ADD, fd, events);
+}
+
+bool poller_modify(struct poller *poller, int fd, unsigned int events)
+{
+#if defined(USE_IO_URING) && USE_IO_URING == 1
+	if (poller->uring)
+		return uring_watch(poller->uring, fd, events);
+#endif
+	return poller_ctl(poller, EPOLL_CTL_MOD, fd, events);
+}
+
+bool poller_remove(struct poller *poller, int fd)
+{
+#if defined(USE_IO_URING) && USE_IO_URING == 1
+	if (poller->uring)
+		return uring_unwatch(poller->uring, fd);
+#endif
+	return poller_ctl(poller, EPOLL_CTL_DEL, fd, 0);
+}
+
+/*
+ * Waits up to timeout milliseconds (-1 to wait indefinitely) and fills the
+ * events array with at most maxevents ready descriptors. Returns the number
+ * of events, or -1 on error (errno is preserved). The data of POLLER_RECV
+ * events is valid until the next call.
+ */
+int poller_wait(struct poller *poller, struct poller_event *events,
+		int maxevents, int timeout)
+{
+	int ready, i;
+
+	if (maxevents > POLLER_MAX_EVENTS)
+		maxevents = POLLER_MAX_EVENTS;
+
+#if defined(USE_IO_URING) && USE_IO_URING == 1
+	if (poller->uring)
+		return uring_wait(poller->uring, events, maxevents, timeout);
+#endif
+
+	ready = epoll_wait(poller->epfd, poller->events, maxevents, timeout);
+	for (i = 0; i < ready; i++) {
+		events[i].fd = poller->events[i].data.fd;
+		events[i].events = from_epoll_events(poller->events[i].events);
+		events[i].result = 0;
+		events[i].data = NULL;
+	}
+
+	return ready;
+}
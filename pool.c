@@ -0,0 +1,154 @@
+/*
+ * This file is part of reti2016.
+ *
+ * reti2016 is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * reti2016 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * See file LICENSE for more details.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "console.h"
+#include "pool.h"
+
+/* alignment of the objects */
+#define	POOL_ALIGN	16
+#define	ALIGN_UP(_n)	(((_n) + POOL_ALIGN - 1) & ~(size_t)(POOL_ALIGN - 1))
+
+struct pool_slab {
+	struct pool_slab *next;
+};
+
+/* the slabs and their first object start on a cache line boundary: objects
+ * whose size is a multiple of the line size never straddle two lines more
+ * than needed */
+#define	SLAB_HEADER_SIZE	CACHE_LINE_SIZE
+
+/* size of an object in the slabs: it must hold the free list link */
+static size_t slot_size(struct pool *p)
+{
+	return ALIGN_UP(p->obj_size < sizeof(void *) ?
+			sizeof(void *) : p->obj_size);
+}
+
+void pool_init(struct pool *p, const char *name, size_t obj_size,
+		size_t per_slab)
+{
+	p->name = name;
+	p->obj_size = obj_size;
+	p->per_slab = per_slab;
+	p->free_list = NULL;
+	p->slabs = NULL;
+	p->slab_count = p->in_use = p->peak = 0;
+}
+
+/*
+ * Releases all the slabs. The objects still in use become invalid.
+ */
+void pool_destroy(struct pool *p)
+{
+	struct pool_slab *s, *next;
+
+	for (s = p->slabs; s; s = next) {
+		next = s->next;
+		free(s);
+	}
+	p->free_list = NULL;
+	p->slabs = NULL;
+	p->slab_count = p->in_use = 0;
+}
+
+/*
+ * Allocates a slab and puts its objects in the free list. The memory is
+ * written, so that its pages are mapped now rather than at the first use of
+ * each object. Returns false on error.
+ */
+static bool add_slab(struct pool *p)
+{
+	struct pool_slab *s;
+	size_t i, size = slot_size(p);
+	char *obj;
+	void *mem;
+	int err;
+
+	err = posix_memalign(&mem, CACHE_LINE_SIZE,
+			SLAB_HEADER_SIZE + p->per_slab * size);
+	if (err) {
+		print_error("posix_memalign", err);
+		return false;
+	}
+	s = mem;
+	memset(s, 0, SLAB_HEADER_SIZE + p->per_slab * size);
+	s->next = p->slabs;
+	p->slabs = s;
+	p->slab_count++;
+
+	obj = (char *)s + SLAB_HEADER_SIZE;
+	for (i = 0; i < p->per_slab; i++, obj += size) {
+		*(void **)obj = p->free_list;
+		p->free_list = obj;
+	}
+	return true;
+}
+
+/*
+ * Makes room for count objects in use without further allocations.
+ * Returns false on error.
+ */
+bool pool_prefault(struct pool *p, size_t count)
+{
+	while (p->slab_count * p->per_slab < count)
+		if (!add_slab(p))
+			return false;
+	return true;
+}
+
+/*
+ * Returns a new object, or NULL on error.
+ */
+void *pool_alloc(struct pool *p)
+{
+	void *obj;
+
+	if (!p->free_list && !add_slab(p))
+		return NULL;
+
+	obj = p->free_list;
+	p->free_list = *(void **)obj;
+	if (++p->in_use > p->peak)
+		p->peak = p->in_use;
+	return obj;
+}
+
+void pool_free(struct pool *p, void *obj)
+{
+	if (!obj)
+		return;
+
+	*(void **)obj = p->free_list;
+	p->free_list = obj;
+	p->in_use--;
+}
+
+/*
+ * Prints the occupancy of the pool.
+ */
+void pool_print_stats(struct pool *p)
+{
+	size_t capacity = p->slab_count * p->per_slab;
+
+	printf("Pool %s: %lu/%lu objects in use (peak %lu), %lu slabs, %lu bytes\n",
+			p->name, (unsigned long)p->in_use,
+			(unsigned long)capacity, (unsigned long)p->peak,
+			(unsigned long)p->slab_count,
+			(unsigned long)(capacity * slot_size(p)));
+}
@@ -25,6 +25,7 @@
 #ifdef	BATTLE_SERVER
 #include <arpa/inet.h>
 #include "client_list.h"
+#include "reactor.h"
 #endif
 
 /* TODO: check source address on UDP read */
@@ -37,8 +38,8 @@
 static const char *msg_type_name[] = {"REQ_LOGIN", "ANS_LOGIN", "REQ_WHO",
 				"ANS_WHO", "REQ_PLAY", "REQ_PLAY_ANS",
 				"ANS_PLAY", "MSG_READY", "MSG_SHOT",
-				"MSG_RESULT", "MSG_ENDGAME", "", "", "", "",
-				"ANS_BADREQ"};
+				"MSG_RESULT", "MSG_ENDGAME", "ANS_BUSY",
+				"REQ_MATCHES", "ANS_MATCHES", "", "ANS_BADREQ"};
 
 inline const char *message_type_name(enum msg_type type)
 {
@@ -82,6 +83,12 @@ static bool valid_message_header(struct msg_header mh)
 		return mh.length == MSG_BODY_SIZE(struct msg_result);
 	case MSG_ENDGAME:
 		return mh.length == MSG_BODY_SIZE(struct msg_endgame);
+	case ANS_BUSY:
+		return mh.length == MSG_BODY_SIZE(struct ans_busy);
+	case REQ_MATCHES:
+		return mh.length == MSG_BODY_SIZE(struct req_matches);
+	case ANS_MATCHES:
+		return (mh.length % sizeof(struct match_entry)) == 0;
 	case ANS_BADREQ:
 		return mh.length == MSG_BODY_SIZE(struct ans_badreq);
 	}
@@ -90,8 +97,8 @@ static bool valid_message_header(struct msg_header mh)
 }
 
 /*
- * Dumps a message on the screen. This function is provided only if
- * BATTLE_SERVER is defined.
+ * Dumps a message in the log of the server. This function is provided only
+ * if BATTLE_SERVER is defined.
  */
 #ifdef	BATTLE_SERVER
 static void dump_message(struct message *msg, int sockfd, bool send)
@@ -99,58 +106,66 @@ static void dump_message(struct message *msg, int sockfd, bool send)
 	struct game_client *client;
 	char addrstr[ADDRESS_STRING_LENGTH] = "<error>";
 
-	client = get_client_by_socket(sockfd);
+	client = reactor_find_client(sockfd);
 
-	printf("%s %s (length=%" PRIu32 ") {", send ? "Sending" : "Received",
+	reactor_log("%s %s (length=%" PRIu32 ") {",
+			send ? "Sending" : "Received",
 			message_type_name(msg->header.type),
 			msg->header.length);
 
 	switch (msg->header.type) {
 	case REQ_LOGIN:
-		printf("username=%s; udp_port=%" PRIu16,
+		reactor_log("username=%s; udp_port=%" PRIu16,
 				((struct req_login *)msg)->username,
 				ntohs(((struct req_login *)msg)->udp_port));
 		break;
 	case ANS_LOGIN:
-		printf("response=%d", ((struct ans_login *)msg)->response);
+		reactor_log("response=%d", ((struct ans_login *)msg)->response);
 		break;
 	case ANS_WHO:
-		printf("... (n. of players: %lu) ...",
+		reactor_log("... (n. of players: %lu) ...",
 				msg->header.length /
 				sizeof(struct who_player));
 		break;
+	case ANS_MATCHES:
+		reactor_log("... (n. of matches: %lu) ...",
+				msg->header.length /
+				sizeof(struct match_entry));
+		break;
 	case REQ_PLAY:
-		printf("opponent=%s", ((struct req_play *)msg)->opponent);
+		reactor_log("opponent=%s", ((struct req_play *)msg)->opponent);
 		break;
 	case REQ_PLAY_ANS:
-		printf("accept=%s", ((struct req_play_ans *)msg)->accept ?
+		reactor_log("accept=%s", ((struct req_play_ans *)msg)->accept ?
 				"true" : "false");
 		break;
 	case ANS_PLAY:
 		inet_ntop(ADDRESS_FAMILY, &((struct ans_play *)msg)->address,
 				addrstr, ADDRESS_STRING_LENGTH);
-		printf("response=%d; address=%s; port=%" PRIu16,
+		reactor_log("response=%d; address=%s; port=%" PRIu16,
 				((struct ans_play *)msg)->response,
 				addrstr,
 				ntohs(((struct ans_play *)msg)->udp_port));
 		break;
 	case MSG_ENDGAME:
-		printf("disconnected=%s",
+		reactor_log("disconnected=%s",
 				((struct msg_endgame *)msg)->disconnected ?
 				"true" : "false");
 		break;
 	case REQ_WHO:
+	case REQ_MATCHES:
+	case ANS_BUSY:
 	case ANS_BADREQ:
-		fputs("... (empty) ...", stdout);
+		reactor_log("... (empty) ...");
 		break;
 	default:
-		fputs("???", stdout);
+		reactor_log("???");
 	}
 
-	printf("} %s ", send ? "to" : "from");
-	if (logged_in(client))
-		printf("%s on ", client->username);
-	printf("socket %d\n", sockfd);
+	reactor_log("} %s ", send ? "to" : "from");
+	if (client && logged_in(client))
+		reactor_log("%s on ", client->username);
+	reactor_log("socket %d\n", sockfd);
 }
 #endif
 
@@ -218,6 +233,42 @@ static struct message *_read_message(int sockfd, bool connected, bool *noblock)
 	return NULL;
 }
 
+/*
+ * Looks for a complete message at the beginning of the len bytes pointed by
+ * buf, without copying it. On return *msg points to the message inside buf,
+ * or is NULL if more bytes are needed. Returns false if buf does not start
+ * with a valid message.
+ */
+bool parse_message(int sockfd, char *buf, size_t len, struct message **msg)
+{
+	struct msg_header mh;
+
+	*msg = NULL;
+	if (len < sizeof(struct msg_header))
+		return true;
+
+	memcpy(&mh, buf, sizeof(struct msg_header));
+	if (!valid_message_header(mh)) {
+		printf_error("parse_message: received an invalid message from socket %d",
+				sockfd);
+		return false;
+	}
+	if (len < sizeof(struct msg_header) + mh.length)
+		return true;
+
+	*msg = (struct message *)buf;
+#ifdef	BATTLE_SERVER
+	dump_message(*msg, sockfd, false);
+#endif
+	if (mh.type == ANS_BADREQ) {
+		printf_error("parse_message: received ANS_BADREQ from socket %d",
+				sockfd);
+		*msg = NULL;
+		return false;
+	}
+	return true;
+}
+
 struct message *read_message(int sockfd)
 {
 	return _read_message(sockfd, true, NULL);
@@ -255,6 +306,11 @@ struct message *read_message_type(int sockfd, enum msg_type type)
 	else
 		msg = read_message(sockfd);
 
+	if (msg && msg->header.type == ANS_BUSY && type != ANS_BUSY) {
+		print_error("The server is busy. Please try again later.", 0);
+		delete_message(msg);
+		return NULL;
+	}
 	if (msg && msg->header.type != type) {
 		printf_error("read_message_type: received wrong message type from socket %d",
 				sockfd);
@@ -277,12 +333,17 @@ static bool _write_message(int sockfd, struct message *msg,
 
 #ifdef	BATTLE_SERVER
 	dump_message(msg, sockfd, true);
-#endif
 
+	if (!dest && reactor_send(sockfd, msg,
+				sizeof(struct msg_header) +
+				msg->header.length))
+		return true;
+#else
 	if (write_socket(sockfd, dest, msg,
 				sizeof(struct msg_header) +
 				msg->header.length, 0))
 		return true;
+#endif
 
 	printf_error("_write_message: error writing message %s to socket %d",
 			message_type_name(msg->header.type), sockfd);
@@ -330,6 +391,7 @@ bool send_ans_login(int sockfd, enum login_response response)
 	case LOGIN_OK:
 	case LOGIN_INVALID_NAME:
 	case LOGIN_NAME_INUSE:
+	case LOGIN_ALREADY_LOGGED_IN:
 		msg.response = response;
 		break;
 	default:
@@ -376,6 +438,62 @@ bool send_ans_who(int sockfd, struct who_player players[], int count)
 	return res;
 }
 
+/*
+ * Sends a message of type made of the count entries of size in a list shared
+ * between requests, leaving out the one at index skip (if not negative),
+ * without copying them: they are copied only once, into the output queue of
+ * the client.
+ */
+#ifdef	BATTLE_SERVER
+static bool send_shared_array(int sockfd, enum msg_type type,
+		const char *entries, size_t size, int count, int skip)
+{
+	struct msg_header header;
+	struct iovec iov[3];
+	int iovcnt = 1;
+
+	header.magic[0] = 'B';
+	header.magic[1] = 'P';
+	header.type = type;
+	header._reserved = 0x00;
+	header.length = (count - (skip >= 0)) * size;
+
+	dump_message((struct message *)&header, sockfd, true);
+
+	iov[0].iov_base = &header;
+	iov[0].iov_len = sizeof(header);
+	if (skip < 0)
+		skip = count;
+	if (skip > 0) {
+		iov[iovcnt].iov_base = (void *)entries;
+		iov[iovcnt++].iov_len = skip * size;
+	}
+	if (skip + 1 < count) {
+		iov[iovcnt].iov_base = (void *)(entries + (skip + 1) * size);
+		iov[iovcnt++].iov_len = (count - skip - 1) * size;
+	}
+
+	if (reactor_sendv(sockfd, iov, iovcnt))
+		return true;
+
+	printf_error("send_shared_array: error writing message %s "
+			"to socket %d", message_type_name(type), sockfd);
+	return false;
+}
+
+/*
+ * Sends the count players of a shared list, leaving out the one at index
+ * skip (if not negative). This function is provided only if BATTLE_SERVER is
+ * defined.
+ */
+bool send_ans_who_shared(int sockfd, const struct who_player players[],
+		int count, int skip)
+{
+	return send_shared_array(sockfd, ANS_WHO, (const char *)players,
+			sizeof(struct who_player), count, skip);
+}
+#endif
+
 bool send_req_play(int sockfd, const char *opponent)
 {
 	struct req_play msg;
@@ -426,6 +544,7 @@ bool send_ans_play(int sockfd, enum play_response response,
 	case PLAY_INVALID_OPPONENT:
 	case PLAY_TIMEDOUT:
 	case PLAY_OPPONENT_IN_GAME:
+	case PLAY_ALREADY_IN_GAME:
 		msg.response = response;
 		break;
 	default:
@@ -448,6 +567,65 @@ bool send_msg_endgame(int sockfd, bool disconnected)
 	return write_message(sockfd, (struct message *)&msg);
 }
 
+bool send_ans_busy(int sockfd)
+{
+	struct ans_busy msg;
+
+	msg.header.type = ANS_BUSY;
+	msg.header.length = MSG_BODY_SIZE(struct ans_busy);
+
+	return write_message(sockfd, (struct message *)&msg);
+}
+
+bool send_req_matches(int sockfd)
+{
+	struct req_matches msg;
+
+	msg.header.type = REQ_MATCHES;
+	msg.header.length = MSG_BODY_SIZE(struct req_matches);
+
+	return write_message(sockfd, (struct message *)&msg);
+}
+
+bool send_ans_matches(int sockfd, struct match_entry matches[], int count)
+{
+	struct ans_matches *msg;
+	size_t array_size;
+	bool res;
+
+	array_size = count * sizeof(struct match_entry);
+
+	errno = 0;
+	msg = malloc(sizeof(struct msg_header) + array_size);
+	if (!msg) {
+		print_error("malloc", errno);
+		return false;
+	}
+
+	msg->header.type = ANS_MATCHES;
+	msg->header.length = array_size;
+
+	if (matches && array_size > 0)
+		memcpy(msg->matches, matches, array_size);
+
+	res = write_message(sockfd, (struct message *)msg);
+	free(msg);
+	return res;
+}
+
+/*
+ * Sends the count matches of a shared list. This function is provided only if
+ * BATTLE_SERVER is defined.
+ */
+#ifdef	BATTLE_SERVER
+bool send_ans_matches_shared(int sockfd, const struct match_entry matches[],
+		int count)
+{
+	return send_shared_array(sockfd, ANS_MATCHES, (const char *)matches,
+			sizeof(struct match_entry), count, -1);
+}
+#endif
+
 bool send_ans_badreq(int sockfd)
 {
 	struct ans_badreq msg;
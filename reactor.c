@@ -0,0 +1,716 @@
+/*
+ * This file is part of reti2016.
+ *
+ * reti2016 is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * reti2016 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * See file LICENSE for more details.
+ */
+
+#include <errno.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include "client_list.h"
+#include "console.h"
+#include "netutil.h"
+#include "proto.h"
+#include "reactor.h"
+#include "timer.h"
+
+/* the dispatch stops above the high-water mark, before the disconnection */
+#if OUTPUT_QUEUE_LIMIT <= OUTPUT_HIGH_WATER_MARK
+#error "OUTPUT_QUEUE_LIMIT must be higher than OUTPUT_HIGH_WATER_MARK"
+#endif
+
+/* room reserved in the log for a line before formatting it */
+#define	LOG_LINE_SIZE	256
+
+static pthread_key_t current_key;
+static pthread_once_t current_key_once = PTHREAD_ONCE_INIT;
+
+/* all the initialized reactors: they must be initialized before any of them
+ * starts, and destroyed once all of them have been joined */
+static struct reactor *reactor_list;
+
+static void create_current_key()
+{
+	pthread_key_create(&current_key, NULL);
+}
+
+/*
+ * Creates the poller of the reactor and starts watching the listening sockets,
+ * the mailbox and the signalfd, if any.
+ */
+bool reactor_init(struct reactor *r, unsigned int id, int sfd, int usfd,
+		int sigfd)
+{
+	r->id = id;
+	r->sfd = sfd;
+	r->usfd = usfd;
+	r->sigfd = sigfd;
+	r->dirty = NULL;
+	r->dirty_count = r->dirty_size = 0;
+	r->pending = NULL;
+	r->pending_head = r->pending_count = r->pending_size = 0;
+	r->deferred = NULL;
+	r->deferred_head = r->deferred_count = r->deferred_size = 0;
+	BUFFER_INIT(&r->log);
+	r->log_queued = false;
+	r->stopping = false;
+	r->now = timer_clock();
+	FDTABLE_INIT(&r->clients);
+
+	if (!mailbox_init(&r->mailbox))
+		return false;
+
+	r->poller = poller_create();
+	if (!r->poller || !poller_add(r->poller, sfd, POLLER_ACCEPT) ||
+			(usfd != -1 && !poller_add(r->poller, usfd,
+				POLLER_ACCEPT | POLLER_EXCLUSIVE)) ||
+			!poller_add(r->poller, MAILBOX_FD(&r->mailbox),
+				POLLER_IN) ||
+			(sigfd != -1 && !poller_add(r->poller, sigfd,
+				POLLER_IN))) {
+		poller_destroy(r->poller);
+		mailbox_destroy(&r->mailbox);
+		return false;
+	}
+
+	r->next = reactor_list;
+	reactor_list = r;
+	return true;
+}
+
+/*
+ * Frees the resources of a reactor, whose clients must have been removed.
+ */
+void reactor_destroy(struct reactor *r)
+{
+	struct reactor **p;
+
+	for (p = &reactor_list; *p; p = &(*p)->next)
+		if (*p == r) {
+			*p = r->next;
+			break;
+		}
+
+	fdtable_free(&r->clients);
+	poller_destroy(r->poller);
+	mailbox_destroy(&r->mailbox);
+	if (r->dirty)
+		free(r->dirty);
+	if (r->pending)
+		free(r->pending);
+	if (r->deferred)
+		free(r->deferred);
+	buffer_free(&r->log);
+}
+
+bool reactor_start(struct reactor *r, void *(*loop)(void *))
+{
+	int err;
+
+	if ((err = pthread_create(&r->thread, NULL, loop, r)) != 0) {
+		print_error("pthread_create", err);
+		return false;
+	}
+	return true;
+}
+
+/*
+ * Interrupts the wait of the reactor for events, if any.
+ */
+void reactor_wake(struct reactor *r)
+{
+	mailbox_wake(&r->mailbox);
+}
+
+/*
+ * Asks the reactor to stop. Its thread exits at the end of the current
+ * iteration.
+ */
+void reactor_stop(struct reactor *r)
+{
+	__atomic_store_n(&r->stopping, true, __ATOMIC_RELEASE);
+	reactor_wake(r);
+}
+
+/*
+ * Waits for the thread of the reactor to exit.
+ */
+void reactor_join(struct reactor *r)
+{
+	int err;
+
+	if ((err = pthread_join(r->thread, NULL)) != 0)
+		print_error("pthread_join", err);
+}
+
+bool reactor_stopping(struct reactor *r)
+{
+	return __atomic_load_n(&r->stopping, __ATOMIC_ACQUIRE);
+}
+
+/*
+ * Binds r to the calling thread.
+ */
+void set_current_reactor(struct reactor *r)
+{
+	pthread_once(&current_key_once, create_current_key);
+	pthread_setspecific(current_key, r);
+}
+
+struct reactor *current_reactor()
+{
+	pthread_once(&current_key_once, create_current_key);
+	return (struct reactor *)pthread_getspecific(current_key);
+}
+
+/*
+ * Returns the client owned by r connected on fd, or NULL. Called by the owner
+ * without locking, by the other threads with the client list locked.
+ */
+struct game_client *reactor_client(struct reactor *r, int fd)
+{
+	return (struct game_client *)fdtable_search(&r->clients, fd);
+}
+
+/*
+ * Returns the client connected on fd, looking first among the clients of the
+ * calling reactor, then among those of the others. Only the first lookup can
+ * be done without locking: the client list must be locked unless the client
+ * is owned by the caller.
+ */
+struct game_client *reactor_find_client(int fd)
+{
+	struct reactor *r, *cur = current_reactor();
+	struct game_client *client;
+
+	if (cur && (client = reactor_client(cur, fd)))
+		return client;
+	for (r = reactor_list; r; r = r->next)
+		if (r != cur && (client = reactor_client(r, fd)))
+			return client;
+	return NULL;
+}
+
+/*
+ * Watches the socket of a client for the events required by its state: the
+ * output readiness while bytes are queued or requests are stalled, and the
+ * input unless the client is throttled, i.e. its output queue went above the
+ * high-water mark and has not yet drained below the low-water mark, it has
+ * input waiting for the next iteration or a request served by a worker.
+ */
+void reactor_update_interest(struct reactor *r, struct game_client *client)
+{
+	size_t queued = CLIENT_OUTPUT_LENGTH(client);
+	unsigned int events;
+
+	if (client->write_failed)
+		client->throttled = false;
+	else if (queued > OUTPUT_HIGH_WATER_MARK)
+		client->throttled = true;
+	else if (queued <= OUTPUT_LOW_WATER_MARK)
+		client->throttled = false;
+
+	events = (client->throttled || client->pending || client->busy) ?
+		0 : POLLER_RECV;
+	if (queued > 0 || client->stalled)
+		events |= POLLER_OUT;
+
+	if (events != client->poll_events &&
+			poller_modify(r->poller, client->sock, events))
+		client->poll_events = events;
+}
+
+/*
+ * Discards the output of a client and shuts its socket down: the connection
+ * is closed once the poller reports the end of file.
+ */
+static void drop_output(struct reactor *r, struct game_client *client)
+{
+	client->write_failed = true;
+	shutdown(client->sock, SHUT_RDWR);
+	buffer_free(&client->outbuf);
+	buffer_free(&client->bulkbuf);
+	client->bulk_left = 0;
+	reactor_update_interest(r, client);
+}
+
+/*
+ * Returns true if the message in buf is bulk data (the list of players or
+ * of matches), which is sent after the control messages queued for the same
+ * client.
+ */
+static bool bulk_message(const char *buf)
+{
+	enum msg_type type = ((const struct msg_header *)buf)->type;
+
+	return type == ANS_WHO || type == ANS_MATCHES;
+}
+
+/*
+ * Queues the message gathered from the iovcnt buffers in iov for a client
+ * owned by r; the header must be entirely in the first buffer. It is sent by
+ * the flush stage at the end of the current iteration, together with all the
+ * other messages queued for the client in the meantime. A client whose queue
+ * exceeds OUTPUT_QUEUE_LIMIT is disconnected. A bulk message is not counted
+ * against the limit, only the output already queued before it is: the lists
+ * grow with the players, without bound, while the requests of a client stop
+ * being dispatched above OUTPUT_HIGH_WATER_MARK, so each list is answered
+ * once at most per drain of the queue. Returns false on error.
+ */
+static bool queue_output(struct reactor *r, struct game_client *client,
+		const struct iovec *iov, int iovcnt)
+{
+	struct buffer *out;
+	struct game_client **dirty;
+	size_t size, len;
+	char *dst;
+	bool bulk;
+	int i;
+
+	if (client->write_failed)
+		return false;
+
+	bulk = bulk_message(iov[0].iov_base);
+	out = bulk ? &client->bulkbuf : &client->outbuf;
+	for (i = 0, len = 0; i < iovcnt; i++)
+		len += iov[i].iov_len;
+
+	if (CLIENT_OUTPUT_LENGTH(client) + (bulk ? 0 : len) >
+			OUTPUT_QUEUE_LIMIT) {
+		printf_error("queue_output: output queue full on socket %d. Disconnecting",
+				client->sock);
+		drop_output(r, client);
+		return false;
+	}
+
+	/* the whole message or nothing */
+	if (!(dst = buffer_reserve(out, len)))
+		return false;
+	for (i = 0; i < iovcnt; dst += iov[i].iov_len, i++)
+		memcpy(dst, iov[i].iov_base, iov[i].iov_len);
+	buffer_commit(out, len);
+
+	/* already waiting for the flush stage or for the output readiness */
+	if (client->dirty || (client->poll_events & POLLER_OUT))
+		return true;
+
+	if (r->dirty_count == r->dirty_size) {
+		size = r->dirty_size ? r->dirty_size * 2 : 64;
+		errno = 0;
+		dirty = realloc(r->dirty, size * sizeof(struct game_client *));
+		if (!dirty) {
+			print_error("realloc", errno);
+			return reactor_flush(r, client);
+		}
+		r->dirty = dirty;
+		r->dirty_size = size;
+	}
+	r->dirty[r->dirty_count++] = client;
+	client->dirty = true;
+	return true;
+}
+
+/*
+ * Removes the first len bytes sent from the output queues of a client, in the
+ * order they have been passed to sendmsg() by reactor_flush().
+ */
+static void consume_output(struct game_client *client, size_t len)
+{
+	struct buffer *bulk = &client->bulkbuf;
+	struct msg_header header;
+	size_t n;
+
+	n = (len < client->bulk_left) ? len : client->bulk_left;
+	buffer_consume(bulk, n);
+	client->bulk_left -= n;
+	len -= n;
+
+	n = (len < BUFFER_LENGTH(&client->outbuf)) ?
+		len : BUFFER_LENGTH(&client->outbuf);
+	buffer_consume(&client->outbuf, n);
+	len -= n;
+
+	if (len == 0)
+		return;
+
+	/* the last bulk message sent may have been cut */
+	for (n = 0; n < len; n += sizeof(struct msg_header) + header.length)
+		memcpy(&header, BUFFER_DATA(bulk) + n,
+				sizeof(struct msg_header));
+	client->bulk_left = n - len;
+	buffer_consume(bulk, len);
+}
+
+/*
+ * Sends the messages queued for a client owned by r, as many bytes as the
+ * socket accepts with a single system call, and watches for the output
+ * readiness if some are left. Control messages go before bulk messages,
+ * except for the rest of a bulk message already partially sent. Returns
+ * false on error.
+ */
+bool reactor_flush(struct reactor *r, struct game_client *client)
+{
+	struct buffer *out = &client->outbuf, *bulk = &client->bulkbuf;
+	size_t left = client->bulk_left;
+	struct iovec iov[3];
+	struct msghdr mh;
+	ssize_t sent;
+
+	if (CLIENT_OUTPUT_LENGTH(client) > 0) {
+		memset(&mh, 0, sizeof(mh));
+		mh.msg_iov = iov;
+		if (left > 0) {
+			iov[mh.msg_iovlen].iov_base = BUFFER_DATA(bulk);
+			iov[mh.msg_iovlen++].iov_len = left;
+		}
+		if (BUFFER_LENGTH(out) > 0) {
+			iov[mh.msg_iovlen].iov_base = BUFFER_DATA(out);
+			iov[mh.msg_iovlen++].iov_len = BUFFER_LENGTH(out);
+		}
+		if (BUFFER_LENGTH(bulk) > left) {
+			iov[mh.msg_iovlen].iov_base = BUFFER_DATA(bulk) + left;
+			iov[mh.msg_iovlen++].iov_len =
+				BUFFER_LENGTH(bulk) - left;
+		}
+
+		do {
+			errno = 0;
+			sent = sendmsg(client->sock, &mh,
+					MSG_NOSIGNAL | MSG_DONTWAIT);
+		} while (sent == -1 && errno == EINTR);
+
+		if (sent == -1 && errno != EAGAIN && errno != EWOULDBLOCK) {
+			print_error("sendmsg", errno);
+			return false;
+		}
+		if (sent > 0)
+			consume_output(client, sent);
+	}
+
+	reactor_update_interest(r, client);
+	return true;
+}
+
+/*
+ * Flush stage, run at the end of every iteration of the reactor: sends the
+ * output queued for each client during the iteration. Clients that cannot
+ * be written are disconnected.
+ */
+void reactor_flush_dirty(struct reactor *r)
+{
+	struct game_client *client;
+	size_t i;
+
+	for (i = 0; i < r->dirty_count; i++) {
+		client = r->dirty[i];
+		client->dirty = false;
+		if (!reactor_flush(r, client))
+			drop_output(r, client);
+	}
+	r->dirty_count = 0;
+}
+
+/*
+ * Queues a client owned by r whose input has been left over by the dispatch
+ * budget: it is served again at the next iteration, after the clients queued
+ * before it. Its socket is not read in the meantime. Returns false on error.
+ */
+bool reactor_defer_input(struct reactor *r, struct game_client *client)
+{
+	struct game_client **pending;
+	size_t i, size;
+
+	if (client->pending)
+		return true;
+
+	if (r->pending_count == r->pending_size) {
+		size = r->pending_size ? r->pending_size * 2 : 64;
+		errno = 0;
+		pending = malloc(size * sizeof(struct game_client *));
+		if (!pending) {
+			print_error("malloc", errno);
+			return false;
+		}
+		for (i = 0; i < r->pending_count; i++)
+			pending[i] = r->pending[(r->pending_head + i) %
+				r->pending_size];
+		if (r->pending)
+			free(r->pending);
+		r->pending = pending;
+		r->pending_head = 0;
+		r->pending_size = size;
+	}
+
+	r->pending[(r->pending_head + r->pending_count) % r->pending_size] =
+		client;
+	r->pending_count++;
+	client->pending = true;
+	reactor_update_interest(r, client);
+	return true;
+}
+
+/*
+ * Removes the first client from the queue of the clients with input left
+ * over. Returns NULL if the entry belongs to a removed client or the queue is
+ * empty.
+ */
+struct game_client *reactor_next_pending(struct reactor *r)
+{
+	struct game_client *client;
+
+	if (r->pending_count == 0)
+		return NULL;
+
+	client = r->pending[r->pending_head];
+	r->pending_head = (r->pending_head + 1) % r->pending_size;
+	r->pending_count--;
+	if (client)
+		client->pending = false;
+	return client;
+}
+
+/*
+ * Drops every reference to a client owned by r that is about to be removed.
+ */
+void reactor_forget(struct reactor *r, struct game_client *client)
+{
+	size_t i;
+
+	mailbox_forget(&r->mailbox, client);
+
+	if (client->pending) {
+		for (i = 0; i < r->pending_count; i++)
+			if (r->pending[(r->pending_head + i) %
+					r->pending_size] == client)
+				r->pending[(r->pending_head + i) %
+					r->pending_size] = NULL;
+		client->pending = false;
+	}
+
+	if (!client->dirty)
+		return;
+	for (i = 0; i < r->dirty_count; i++)
+		if (r->dirty[i] == client) {
+			r->dirty[i] = r->dirty[--r->dirty_count];
+			break;
+		}
+	client->dirty = false;
+}
+
+/*
+ * Sends the message gathered from the iovcnt buffers in iov to the client
+ * connected on sockfd: it is queued on the client if it is owned by the
+ * calling reactor, posted to the mailbox of its owner otherwise. The header
+ * must be entirely in the first buffer. The client list must be locked unless
+ * the client is owned by the caller (see reactor_find_client()).
+ */
+bool reactor_sendv(int sockfd, const struct iovec *iov, int iovcnt)
+{
+	struct game_client *client;
+	int i;
+
+	client = reactor_find_client(sockfd);
+	if (!client || !client->owner) {
+		for (i = 0; i < iovcnt; i++)
+			if (!write_socket(sockfd, NULL, iov[i].iov_base,
+						iov[i].iov_len, 0))
+				return false;
+		return true;
+	}
+	if (client->owner != current_reactor())
+		return mailbox_postv(&client->owner->mailbox, client, iov,
+				iovcnt);
+
+	return queue_output(client->owner, client, iov, iovcnt);
+}
+
+/*
+ * Sends len bytes to the client connected on sockfd, as reactor_sendv().
+ */
+bool reactor_send(int sockfd, const void *buf, size_t len)
+{
+	struct iovec iov;
+
+	iov.iov_base = (void *)buf;
+	iov.iov_len = len;
+	return reactor_sendv(sockfd, &iov, 1);
+}
+
+/*
+ * Tells the owner of a client that the worker serving its request is done.
+ * The client must not be removed meanwhile (see workpool_forget()). Returns
+ * false on error.
+ */
+bool reactor_post_work_done(struct game_client *client)
+{
+	/* the notice is an empty mail */
+	return mailbox_post(&client->owner->mailbox, client, "", 0);
+}
+
+/*
+ * Answers the request of a client served by a worker, then resumes the
+ * client.
+ */
+static void work_done(struct reactor *r, struct game_client *client)
+{
+	client->busy = false;
+	client->answer(client);
+	if (BUFFER_LENGTH(&client->inbuf) == 0 ||
+			!reactor_defer_input(r, client))
+		reactor_update_interest(r, client);
+}
+
+/*
+ * Queues the messages posted by other reactors and by the workers to their
+ * recipients.
+ */
+void reactor_deliver_mail(struct reactor *r)
+{
+	struct mail *mail, *m;
+	struct iovec iov;
+
+	mail = mailbox_take(&r->mailbox);
+	for (m = mail; m; m = m->next) {
+		if (m->len == 0) {
+			work_done(r, m->target);
+			continue;
+		}
+		iov.iov_base = m->data;
+		iov.iov_len = m->len;
+		queue_output(r, m->target, &iov, 1);
+	}
+	mailbox_release(&r->mailbox, mail);
+}
+
+/*
+ * Queues work for r to run after the I/O of the current iteration, in the
+ * order it has been queued. Work left over by the budget of an iteration
+ * runs at the next one. Returns false on error.
+ */
+bool reactor_defer_work(struct reactor *r, void (*fn)(void *), void *arg)
+{
+	struct deferred_work *deferred;
+	size_t i, size;
+
+	if (r->deferred_count == r->deferred_size) {
+		size = r->deferred_size ? r->deferred_size * 2 : 64;
+		errno = 0;
+		deferred = malloc(size * sizeof(struct deferred_work));
+		if (!deferred) {
+			print_error("malloc", errno);
+			return false;
+		}
+		for (i = 0; i < r->deferred_count; i++)
+			deferred[i] = r->deferred[(r->deferred_head + i) %
+				r->deferred_size];
+		if (r->deferred)
+			free(r->deferred);
+		r->deferred = deferred;
+		r->deferred_head = 0;
+		r->deferred_size = size;
+	}
+
+	r->deferred[(r->deferred_head + r->deferred_count) %
+		r->deferred_size].fn = fn;
+	r->deferred[(r->deferred_head + r->deferred_count) %
+		r->deferred_size].arg = arg;
+	r->deferred_count++;
+	return true;
+}
+
+/* microseconds elapsed on the monotonic clock */
+static uint64_t clock_us()
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/*
+ * Runs the deferred work of r: all of it if all is true, otherwise until the
+ * deferred work budget of an iteration is spent (at least one item runs).
+ * The work queued meanwhile runs at the next call.
+ */
+void reactor_run_deferred_work(struct reactor *r, bool all)
+{
+	struct deferred_work work;
+	size_t n = r->deferred_count;
+	uint64_t start = clock_us();
+
+	while (n-- > 0) {
+		work = r->deferred[r->deferred_head];
+		r->deferred_head = (r->deferred_head + 1) % r->deferred_size;
+		r->deferred_count--;
+		work.fn(work.arg);
+
+		if (!all && clock_us() - start >= DEFERRED_WORK_BUDGET)
+			break;
+	}
+}
+
+/* writes the log lines of a reactor at once */
+static void flush_log(void *arg)
+{
+	struct reactor *r = arg;
+
+	fwrite(BUFFER_DATA(&r->log), 1, BUFFER_LENGTH(&r->log), stdout);
+	fflush(stdout);
+	buffer_consume(&r->log, BUFFER_LENGTH(&r->log));
+	r->log_queued = false;
+}
+
+/*
+ * printf for the server threads: the output is appended to the log of the
+ * current reactor and written by its deferred work, so that serving a
+ * request doesn't wait for the console. Outside of a reactor the output is
+ * written at once.
+ */
+void reactor_log(const char *fmt, ...)
+{
+	struct reactor *r = current_reactor();
+	va_list ap;
+	char *dst;
+	int len;
+
+	va_start(ap, fmt);
+	if (!r) {
+		vprintf(fmt, ap);
+		va_end(ap);
+		return;
+	}
+	dst = buffer_reserve(&r->log, LOG_LINE_SIZE);
+	len = dst ? vsnprintf(dst, LOG_LINE_SIZE, fmt, ap) : -1;
+	va_end(ap);
+	if (len < 0)
+		return;
+
+	/* longer than expected: format it again with enough room */
+	if (len >= LOG_LINE_SIZE) {
+		dst = buffer_reserve(&r->log, len + 1);
+		if (!dst)
+			return;
+		va_start(ap, fmt);
+		vsnprintf(dst, len + 1, fmt, ap);
+		va_end(ap);
+	}
+	buffer_commit(&r->log, len);
+
+	if (!r->log_queued && reactor_defer_work(r, flush_log, r))
+		r->log_queued = true;
+}
@@ -15,8 +15,11 @@
  */
 
 #include <errno.h>
+#include <pthread.h>
 #include <signal.h>
 #include <string.h>
+#include <unistd.h>
+#include <sys/signalfd.h>
 #include "console.h"
 #include "sighandler.h"
 
@@ -47,3 +50,61 @@ bool sighandler_init()
 		}
 	return true;
 }
+
+/*
+ * Blocks all selected signals in the calling thread (and in the threads it
+ * creates afterwards). The previous signal mask is saved in oldmask.
+ */
+bool sighandler_block(sigset_t *oldmask)
+{
+	sigset_t mask;
+	int i, err;
+
+	sigemptyset(&mask);
+	for (i = 0; signums[i] > 0; i++)
+		sigaddset(&mask, signums[i]);
+
+	if ((err = pthread_sigmask(SIG_BLOCK, &mask, oldmask)) != 0) {
+		print_error("pthread_sigmask", err);
+		return false;
+	}
+	return true;
+}
+
+/*
+ * Returns a non-blocking signalfd readable when one of the selected signals
+ * is pending, or -1 on error. The signals must be blocked in every thread.
+ */
+int sighandler_fd()
+{
+	sigset_t mask;
+	int i, fd;
+
+	sigemptyset(&mask);
+	for (i = 0; signums[i] > 0; i++)
+		sigaddset(&mask, signums[i]);
+
+	errno = 0;
+	fd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+	if (fd == -1)
+		print_error("signalfd", errno);
+	return fd;
+}
+
+/*
+ * Reads a pending signal from the signalfd fd and stores it in
+ * received_signal. Returns the signal number, or 0 if none is pending.
+ */
+int sighandler_read(int fd)
+{
+	struct signalfd_siginfo info;
+
+	errno = 0;
+	if (read(fd, &info, sizeof(info)) != sizeof(info)) {
+		if (errno != EAGAIN)
+			print_error("read", errno);
+		return 0;
+	}
+	received_signal = info.ssi_signo;
+	return info.ssi_signo;
+}
@@ -0,0 +1,167 @@
+/*
+ * This file is part of reti2016.
+ *
+ * reti2016 is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * reti2016 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * See file LICENSE for more details.
+ */
+
+#include <assert.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "skiplist.h"
+
+/*
+ * Returns a random level for a new element: each level above the first is
+ * taken with probability 1/4 (xorshift generator).
+ */
+static int random_level(struct skiplist *sl)
+{
+	int level = 1;
+
+	do {
+		sl->seed ^= sl->seed << 13;
+		sl->seed ^= sl->seed >> 17;
+		sl->seed ^= sl->seed << 5;
+	} while ((sl->seed & 3) == 0 && ++level < SKIPLIST_MAX_LEVEL);
+	return level;
+}
+
+/*
+ * Finds, for every level, the last element with a key lower than key and
+ * stores it in update. Returns the first element with a key greater or
+ * equal to key, or NULL.
+ */
+static struct skiplist_link *find(struct skiplist *sl, const char *key,
+		struct skiplist_link **update)
+{
+	struct skiplist_link *p = &sl->head;
+	int i;
+
+	for (i = sl->level - 1; i >= 0; i--) {
+		while (p->next[i] && strcmp(p->next[i]->key, key) < 0)
+			p = p->next[i];
+		if (update)
+			update[i] = p;
+	}
+	return p->next[0];
+}
+
+void skiplist_init(struct skiplist *sl)
+{
+	int i;
+
+	sl->head.key = NULL;
+	sl->head.level = SKIPLIST_MAX_LEVEL;
+	for (i = 0; i < SKIPLIST_MAX_LEVEL; i++)
+		sl->head.next[i] = NULL;
+	sl->level = 1;
+	sl->count = 0;
+	sl->seed = (unsigned int)time(NULL) ^ (unsigned int)getpid();
+	if (!sl->seed)
+		sl->seed = 1;
+}
+
+/*
+ * Inserts the element containing link with the specified key, which must
+ * stay valid while the element is in the skiplist. The link must not be in a
+ * skiplist already. Elements with equal keys are kept in insertion order.
+ */
+void skiplist_insert(struct skiplist *sl, struct skiplist_link *link,
+		const char *key)
+{
+	struct skiplist_link *update[SKIPLIST_MAX_LEVEL];
+	int i, level;
+
+	/* linking it twice would make a cycle */
+	assert(!link->key);
+
+	find(sl, key, update);
+
+	level = random_level(sl);
+	for (i = sl->level; i < level; i++)
+		update[i] = &sl->head;
+	if (level > sl->level)
+		sl->level = level;
+
+	link->key = key;
+	link->level = level;
+	for (i = 0; i < level; i++) {
+		link->next[i] = update[i]->next[i];
+		update[i]->next[i] = link;
+	}
+	sl->count++;
+}
+
+/*
+ * Removes the element containing link, which must be in the skiplist.
+ */
+void skiplist_remove(struct skiplist *sl, struct skiplist_link *link)
+{
+	struct skiplist_link *update[SKIPLIST_MAX_LEVEL];
+	int i;
+
+	find(sl, link->key, update);
+
+	/* skip the elements with an equal key inserted before */
+	for (i = 0; i < link->level; i++)
+		while (update[i]->next[i] != link)
+			update[i] = update[i]->next[i];
+
+	for (i = 0; i < link->level; i++)
+		update[i]->next[i] = link->next[i];
+	link->key = NULL;
+	while (sl->level > 1 && !sl->head.next[sl->level - 1])
+		sl->level--;
+
+	sl->count--;
+}
+
+/*
+ * Returns the link of the first element with the specified key, or NULL if
+ * there is none.
+ */
+struct skiplist_link *skiplist_search(struct skiplist *sl, const char *key)
+{
+	struct skiplist_link *link;
+
+	link = find(sl, key, NULL);
+	if (!link || strcmp(link->key, key) != 0)
+		return NULL;
+	return link;
+}
+
+/*
+ * Returns the link of the first element with a key greater or equal to key,
+ * or NULL if there is none: a walk resumes from there once its position is
+ * gone.
+ */
+struct skiplist_link *skiplist_search_from(struct skiplist *sl,
+		const char *key)
+{
+	return find(sl, key, NULL);
+}
+
+/*
+ * Walk in order: the position is the link returned last, held by the caller,
+ * so walks can nest. The next link must be fetched before removing the
+ * current one.
+ */
+struct skiplist_link *skiplist_first(struct skiplist *sl)
+{
+	return sl->head.next[0];
+}
+
+struct skiplist_link *skiplist_next(struct skiplist_link *link)
+{
+	return link->next[0];
+}
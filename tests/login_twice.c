@@ -0,0 +1,129 @@
+/*
+ * This file is part of reti2016.
+ *
+ * reti2016 is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * reti2016 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * See file LICENSE for more details.
+ */
+
+
+/*
+ * Checks that a connection logs in only once: a second login, with another
+ * username or with the same one, is refused and leaves the list of the
+ * players as it was.
+ *
+ * Usage: login_twice <port>, with a server listening on localhost.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include "console.h"
+#include "netutil.h"
+#include "proto.h"
+
+#if defined(USE_IPV6_ADDRESSING) && USE_IPV6_ADDRESSING == 1
+#define	LOCALHOST	"::1"
+#else
+#define	LOCALHOST	"127.0.0.1"
+#endif
+
+#define	CHECK(_cond)	do {						\
+		if (!(_cond)) {						\
+			fprintf(stderr, "%s:%d: check failed: %s\n",	\
+					__FILE__, __LINE__, #_cond);	\
+			exit(EXIT_FAILURE);				\
+		}							\
+	} while (0)
+
+static in_port_t server_port;
+
+static int connect_to_localhost()
+{
+#if defined(USE_IPV6_ADDRESSING) && USE_IPV6_ADDRESSING == 1
+	struct in6_addr addr;
+#else
+	struct in_addr addr;
+#endif
+	int sock;
+
+	CHECK(get_network_address(LOCALHOST, &addr));
+	CHECK((sock = connect_to_server(addr, htons(server_port))) != -1);
+	return sock;
+}
+
+static enum login_response login(int sock, const char *username)
+{
+	struct ans_login *ans;
+	enum login_response res;
+
+	CHECK(send_req_login(sock, username, htons(5000)));
+	ans = (struct ans_login *)read_message_type(sock, ANS_LOGIN);
+	CHECK(ans);
+	res = ans->response;
+	delete_message(ans);
+	return res;
+}
+
+/* returns true if the list of the players sent to sock is exactly names */
+static bool who_is(int sock, const char **names, unsigned int count)
+{
+	struct ans_who *ans;
+	unsigned int i;
+	bool res;
+
+	CHECK(send_req_who(sock));
+	ans = (struct ans_who *)read_message_type(sock, ANS_WHO);
+	CHECK(ans);
+	res = ans->header.length == count * sizeof(struct who_player);
+	for (i = 0; res && i < count; i++)
+		res = !strcmp(ans->players[i].username, names[i]);
+	delete_message(ans);
+	return res;
+}
+
+int main(int argc, char **argv)
+{
+	const char *players[] = {"alice", "bob"};
+	int alice, bob, carol, tries;
+
+	if (argc != 2 || !string_to_uint16(argv[1], &server_port)) {
+		printf("Usage: %s <port>\n", argv[0]);
+		exit(EXIT_FAILURE);
+	}
+
+	alice = connect_to_localhost();
+	CHECK(login(alice, "alice") == LOGIN_OK);
+
+	/* alice keeps her username */
+	CHECK(login(alice, "bob") == LOGIN_ALREADY_LOGGED_IN);
+	CHECK(login(alice, "alice") == LOGIN_ALREADY_LOGGED_IN);
+
+	/* the name refused is still free, and alice is listed once */
+	bob = connect_to_localhost();
+	CHECK(login(bob, "bob") == LOGIN_OK);
+	carol = connect_to_localhost();
+	CHECK(who_is(carol, players, 2));
+
+	/* the list survives alice leaving, once the server notices it */
+	close(alice);
+	for (tries = 0; !who_is(carol, players + 1, 1); tries++) {
+		CHECK(tries < 5);
+		sleep(1);
+	}
+
+	close(bob);
+	close(carol);
+	puts("login_twice: OK");
+	return EXIT_SUCCESS;
+}
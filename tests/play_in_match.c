@@ -0,0 +1,147 @@
+/*
+ * This file is part of reti2016.
+ *
+ * reti2016 is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * reti2016 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * See file LICENSE for more details.
+ */
+
+
+/*
+ * Checks that a player already in a match cannot start another one: the
+ * request is refused and, when the player disconnects, the only match left
+ * behind is the one of the other players.
+ *
+ * Usage: play_in_match <port>, with a server listening on localhost.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include "console.h"
+#include "netutil.h"
+#include "proto.h"
+
+#if defined(USE_IPV6_ADDRESSING) && USE_IPV6_ADDRESSING == 1
+#define	LOCALHOST	"::1"
+#else
+#define	LOCALHOST	"127.0.0.1"
+#endif
+
+#define	CHECK(_cond)	do {						\
+		if (!(_cond)) {						\
+			fprintf(stderr, "%s:%d: check failed: %s\n",	\
+					__FILE__, __LINE__, #_cond);	\
+			exit(EXIT_FAILURE);				\
+		}							\
+	} while (0)
+
+static in_port_t server_port;
+
+static int login(const char *username)
+{
+	struct ans_login *ans;
+#if defined(USE_IPV6_ADDRESSING) && USE_IPV6_ADDRESSING == 1
+	struct in6_addr addr;
+#else
+	struct in_addr addr;
+#endif
+	int sock;
+
+	CHECK(get_network_address(LOCALHOST, &addr));
+	CHECK((sock = connect_to_server(addr, htons(server_port))) != -1);
+	CHECK(send_req_login(sock, username, htons(5000)));
+	ans = (struct ans_login *)read_message_type(sock, ANS_LOGIN);
+	CHECK(ans && ans->response == LOGIN_OK);
+	delete_message(ans);
+	return sock;
+}
+
+static enum play_response read_ans_play(int sock)
+{
+	struct ans_play *ans;
+	enum play_response res;
+
+	ans = (struct ans_play *)read_message_type(sock, ANS_PLAY);
+	CHECK(ans);
+	res = ans->response;
+	delete_message(ans);
+	return res;
+}
+
+static void expect_message(int sock, enum msg_type type)
+{
+	struct message *msg;
+
+	msg = read_message_type(sock, type);
+	CHECK(msg);
+	delete_message(msg);
+}
+
+static unsigned int match_count(int sock)
+{
+	struct ans_matches *ans;
+	unsigned int count;
+
+	CHECK(send_req_matches(sock));
+	ans = (struct ans_matches *)read_message_type(sock, ANS_MATCHES);
+	CHECK(ans);
+	count = ans->header.length / sizeof(struct match_entry);
+	delete_message(ans);
+	return count;
+}
+
+int main(int argc, char **argv)
+{
+	int alice, bob, carol, dave;
+
+	if (argc != 2 || !string_to_uint16(argv[1], &server_port)) {
+		printf("Usage: %s <port>\n", argv[0]);
+		exit(EXIT_FAILURE);
+	}
+
+	alice = login("alice");
+	bob = login("bob");
+	carol = login("carol");
+	dave = login("dave");
+
+	/* alice and bob play together */
+	CHECK(send_req_play(alice, "bob"));
+	expect_message(bob, REQ_PLAY);
+	CHECK(send_req_play_ans(bob, true));
+	CHECK(read_ans_play(alice) == PLAY_ACCEPT);
+	CHECK(read_ans_play(bob) == PLAY_ACCEPT);
+
+	/* neither of them can start another match */
+	CHECK(send_req_play(alice, "carol"));
+	CHECK(read_ans_play(alice) == PLAY_ALREADY_IN_GAME);
+	CHECK(send_req_play(bob, "carol"));
+	CHECK(read_ans_play(bob) == PLAY_ALREADY_IN_GAME);
+
+	/* nor can a player waiting for a reply */
+	CHECK(send_req_play(carol, "dave"));
+	expect_message(dave, REQ_PLAY);
+	CHECK(send_req_play(carol, "alice"));
+	CHECK(read_ans_play(carol) == PLAY_ALREADY_IN_GAME);
+	CHECK(match_count(dave) == 2);
+
+	/* the match of alice goes away with her, the other one stays */
+	close(alice);
+	expect_message(bob, MSG_ENDGAME);
+	CHECK(match_count(bob) == 1);
+
+	close(bob);
+	close(carol);
+	close(dave);
+	puts("play_in_match: OK");
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,216 @@
+/*
+ * This file is part of reti2016.
+ *
+ * reti2016 is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * reti2016 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * See file LICENSE for more details.
+ */
+
+#include <limits.h>
+#include <time.h>
+#include "timer.h"
+
+#define	LEVEL_SHIFT(_l)		((_l) * TIMER_WHEEL_BITS)
+#define	SLOT_MASK		(TIMER_WHEEL_SLOTS - 1)
+
+/* no event in the wheel */
+#define	NO_EVENT		UINT64_MAX
+
+/*
+ * Returns the milliseconds elapsed on the monotonic clock.
+ */
+uint64_t timer_clock()
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+void timer_wheel_init(struct timer_wheel *w, uint64_t now)
+{
+	int i, j;
+
+	w->current = now;
+	for (i = 0; i < TIMER_WHEEL_LEVELS; i++) {
+		w->used[i] = 0;
+		for (j = 0; j < TIMER_WHEEL_SLOTS; j++)
+			w->slots[i][j] = NULL;
+	}
+}
+
+static void link_timer(struct timer **head, struct timer *t)
+{
+	t->next = *head;
+	if (t->next)
+		t->next->pprev = &t->next;
+	*head = t;
+	t->pprev = head;
+}
+
+/*
+ * Links the timer in the lowest level where the distance between the slot of
+ * the deadline and the current one is less than a turn. A timer beyond the
+ * last level goes in the last slot of its turn.
+ */
+static void place_timer(struct timer_wheel *w, struct timer *t)
+{
+	uint64_t expires, cur;
+	int level;
+	unsigned int slot;
+
+	expires = (t->deadline < w->current) ? w->current : t->deadline;
+	for (level = 0; level < TIMER_WHEEL_LEVELS; level++) {
+		cur = w->current >> LEVEL_SHIFT(level);
+		if ((expires >> LEVEL_SHIFT(level)) - cur < TIMER_WHEEL_SLOTS)
+			break;
+	}
+
+	if (level < TIMER_WHEEL_LEVELS) {
+		slot = (expires >> LEVEL_SHIFT(level)) & SLOT_MASK;
+	} else {
+		level = TIMER_WHEEL_LEVELS - 1;
+		slot = (cur + TIMER_WHEEL_SLOTS - 1) & SLOT_MASK;
+	}
+
+	link_timer(&w->slots[level][slot], t);
+	w->used[level] |= (uint64_t)1 << slot;
+}
+
+void timer_add(struct timer_wheel *w, struct timer *t, uint64_t deadline)
+{
+	timer_cancel(t);
+	t->deadline = deadline;
+	place_timer(w, t);
+}
+
+void timer_cancel(struct timer *t)
+{
+	if (!TIMER_ARMED(t))
+		return;
+
+	*t->pprev = t->next;
+	if (t->next)
+		t->next->pprev = t->pprev;
+	TIMER_INIT(t);
+}
+
+/*
+ * Returns the first millisecond, not before the current one, when a slot of
+ * the wheel has to be processed (its timers expired, or moved down a level),
+ * or NO_EVENT if the wheel is empty. The slots found empty are marked as
+ * unused on the way.
+ */
+static uint64_t next_event(struct timer_wheel *w)
+{
+	uint64_t next = NO_EVENT, tick, cur, used;
+	unsigned int idx, dist, slot;
+	int level;
+
+	for (level = 0; level < TIMER_WHEEL_LEVELS; level++) {
+		cur = w->current >> LEVEL_SHIFT(level);
+		idx = cur & SLOT_MASK;
+
+		/* the slots in the order of the turn, from the current one */
+		used = w->used[level];
+		if (idx)
+			used = (used >> idx) | (used << (TIMER_WHEEL_SLOTS - idx));
+
+		for (; used; used &= used - 1) {
+			dist = __builtin_ctzll(used);
+			slot = (idx + dist) & SLOT_MASK;
+			if (w->slots[level][slot])
+				break;
+			w->used[level] &= ~((uint64_t)1 << slot);
+		}
+		if (!used)
+			continue;
+
+		tick = (cur + dist) << LEVEL_SHIFT(level);
+		if (tick < w->current)
+			tick = w->current;
+		if (tick < next)
+			next = tick;
+	}
+	return next;
+}
+
+/*
+ * Processes the current millisecond: the timers of the higher levels whose
+ * slot is reached move down, then the timers of the lowest level expire.
+ * Processing the same millisecond again only expires the timers added since.
+ */
+static void run_tick(struct timer_wheel *w)
+{
+	struct timer *list, *t;
+	unsigned int slot;
+	int level;
+
+	for (level = TIMER_WHEEL_LEVELS - 1; level > 0; level--) {
+		if (w->current & (((uint64_t)1 << LEVEL_SHIFT(level)) - 1))
+			continue;
+		slot = (w->current >> LEVEL_SHIFT(level)) & SLOT_MASK;
+		list = w->slots[level][slot];
+		w->slots[level][slot] = NULL;
+		w->used[level] &= ~((uint64_t)1 << slot);
+		for (; list; list = t) {
+			t = list->next;
+			place_timer(w, list);
+		}
+	}
+
+	/* the expired timers are detached first, since the callbacks may cancel
+	 * the other timers of the list and add new ones, even in this slot */
+	slot = w->current & SLOT_MASK;
+	while ((list = w->slots[0][slot])) {
+		w->slots[0][slot] = NULL;
+		list->pprev = &list;
+		while ((t = list)) {
+			timer_cancel(t);
+			t->expire(t);
+		}
+	}
+	w->used[0] &= ~((uint64_t)1 << slot);
+}
+
+/*
+ * Expires all the timers with a deadline up to now, skipping the
+ * milliseconds when nothing happens.
+ */
+void timer_wheel_advance(struct timer_wheel *w, uint64_t now)
+{
+	uint64_t next;
+
+	while ((next = next_event(w)) <= now) {
+		w->current = next;
+		run_tick(w);
+		if (w->current == now)
+			return;
+		w->current++;
+	}
+	if (w->current < now)
+		w->current = now;
+}
+
+/*
+ * Returns the milliseconds from now to the next time the wheel has to be
+ * advanced, suitable as a poll timeout: -1 if the wheel is empty.
+ */
+int timer_wheel_timeout(struct timer_wheel *w, uint64_t now)
+{
+	uint64_t next = next_event(w);
+
+	if (next == NO_EVENT)
+		return -1;
+	if (next <= now)
+		return 0;
+	return (next - now > INT_MAX) ? INT_MAX : (int)(next - now);
+}
@@ -0,0 +1,187 @@
+/*
+ * This file is part of reti2016.
+ *
+ * reti2016 is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * reti2016 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * See file LICENSE for more details.
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+#include "console.h"
+#include "reactor.h"
+#include "workpool.h"
+
+/*
+ * Removes the first job of the queue in item. Returns false if the queue is
+ * empty. Must be called with the pool locked.
+ */
+static bool next_item(struct workpool *wp, struct work_item *item)
+{
+	while (wp->count > 0) {
+		*item = wp->queue[wp->head];
+		wp->head = (wp->head + 1) % wp->size;
+		wp->count--;
+		if (item->client)
+			return true;
+	}
+	return false;
+}
+
+static void *work(void *arg)
+{
+	struct worker *w = arg;
+	struct workpool *wp = w->wp;
+	struct work_item item;
+
+	for (;;) {
+		pthread_mutex_lock(&wp->lock);
+		while (!next_item(wp, &item) && !wp->stopping)
+			pthread_cond_wait(&wp->cond, &wp->lock);
+		if (wp->stopping) {
+			pthread_mutex_unlock(&wp->lock);
+			return NULL;
+		}
+		w->client = item.client;
+		pthread_mutex_unlock(&wp->lock);
+
+		item.fn();
+
+		/* the owner is notified with the pool locked: a client
+		 * forgotten meanwhile is gone, one still there can't be
+		 * removed before workpool_forget() returns */
+		pthread_mutex_lock(&wp->lock);
+		if (w->client)
+			reactor_post_work_done(w->client);
+		w->client = NULL;
+		pthread_mutex_unlock(&wp->lock);
+	}
+}
+
+static void stop_workers(struct workpool *wp, unsigned int count)
+{
+	unsigned int i;
+	int err;
+
+	pthread_mutex_lock(&wp->lock);
+	wp->stopping = true;
+	pthread_cond_broadcast(&wp->cond);
+	pthread_mutex_unlock(&wp->lock);
+
+	for (i = 0; i < count; i++)
+		if ((err = pthread_join(wp->workers[i].thread, NULL)) != 0)
+			print_error("pthread_join", err);
+}
+
+/*
+ * Starts nthreads workers. Returns false on error.
+ */
+bool workpool_init(struct workpool *wp, unsigned int nthreads)
+{
+	unsigned int i;
+	int err;
+
+	pthread_mutex_init(&wp->lock, NULL);
+	pthread_cond_init(&wp->cond, NULL);
+	wp->queue = NULL;
+	wp->head = wp->count = wp->size = 0;
+	wp->nthreads = nthreads;
+	wp->stopping = false;
+
+	errno = 0;
+	wp->workers = malloc(nthreads * sizeof(struct worker));
+	if (!wp->workers) {
+		print_error("malloc", errno);
+		return false;
+	}
+
+	for (i = 0; i < nthreads; i++) {
+		wp->workers[i].wp = wp;
+		wp->workers[i].client = NULL;
+		if ((err = pthread_create(&wp->workers[i].thread, NULL, work,
+						&wp->workers[i])) != 0) {
+			print_error("pthread_create", err);
+			stop_workers(wp, i);
+			free(wp->workers);
+			return false;
+		}
+	}
+	return true;
+}
+
+/*
+ * Stops the workers once they are done with their current job. The jobs
+ * still queued are dropped.
+ */
+void workpool_destroy(struct workpool *wp)
+{
+	stop_workers(wp, wp->nthreads);
+	free(wp->workers);
+	if (wp->queue)
+		free(wp->queue);
+	pthread_cond_destroy(&wp->cond);
+	pthread_mutex_destroy(&wp->lock);
+}
+
+/*
+ * Queues the job fn for a request of client, which is notified once the job
+ * is over. Must be called by the owner of the client. Returns false on error.
+ */
+bool workpool_submit(struct workpool *wp, void (*fn)(void),
+		struct game_client *client)
+{
+	struct work_item *queue;
+	size_t i, size;
+
+	pthread_mutex_lock(&wp->lock);
+	if (wp->count == wp->size) {
+		size = wp->size ? wp->size * 2 : 64;
+		errno = 0;
+		queue = malloc(size * sizeof(struct work_item));
+		if (!queue) {
+			pthread_mutex_unlock(&wp->lock);
+			print_error("malloc", errno);
+			return false;
+		}
+		for (i = 0; i < wp->count; i++)
+			queue[i] = wp->queue[(wp->head + i) % wp->size];
+		if (wp->queue)
+			free(wp->queue);
+		wp->queue = queue;
+		wp->head = 0;
+		wp->size = size;
+	}
+
+	wp->queue[(wp->head + wp->count) % wp->size].fn = fn;
+	wp->queue[(wp->head + wp->count) % wp->size].client = client;
+	wp->count++;
+	pthread_cond_signal(&wp->cond);
+	pthread_mutex_unlock(&wp->lock);
+	return true;
+}
+
+/*
+ * Drops the jobs of a client that is about to be removed: the queued ones
+ * are skipped, and the running ones won't notify it.
+ */
+void workpool_forget(struct workpool *wp, struct game_client *client)
+{
+	size_t i;
+
+	pthread_mutex_lock(&wp->lock);
+	for (i = 0; i < wp->count; i++)
+		if (wp->queue[(wp->head + i) % wp->size].client == client)
+			wp->queue[(wp->head + i) % wp->size].client = NULL;
+	for (i = 0; i < wp->nthreads; i++)
+		if (wp->workers[i].client == client)
+			wp->workers[i].client = NULL;
+	pthread_mutex_unlock(&wp->lock);
+}